@@ -0,0 +1,74 @@
+/*
+ * earchive.h: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  the seekable archive written by emap -archive and read by eunmap
+ *
+ *  the archive is the member ciphertexts one after another, an index with
+ *  an entry per member and a footer at the very end of the file:
+ *
+ *    entry:  offset length start size (8 bytes each) name-length (4 bytes)
+ *            and the name
+ *    footer: "EARCHIV1" index-offset member-count (8 bytes each)
+ *
+ *  numbers are little endian.  offset and length locate the ciphertext in
+ *  the archive, start is the -start value of its corpus region and size is
+ *  the plaintext size - so any one member can be decrypted alone.
+ */
+#ifndef EARCHIVE_H
+#define EARCHIVE_H
+
+#include <stdint.h>
+
+#define EARCHIVE_MAGIC "EARCHIV1"
+#define EARCHIVE_MAGIC_SIZE 8
+#define EARCHIVE_FOOTER_SIZE (EARCHIVE_MAGIC_SIZE + 16)
+#define EARCHIVE_ENTRY_SIZE 36	// without the name
+#define EARCHIVE_NAME_MAX 4096
+
+struct earchive_member
+{
+    uint64_t offset;
+    uint64_t length;
+    uint64_t start;
+    uint64_t size;
+    char *name;
+};
+
+static inline void
+earchive_put(unsigned char *p, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+	p[i] = (value >> (8 * i)) & 0377;
+}
+
+static inline uint64_t
+earchive_get(const unsigned char *p, int bytes)
+{
+    uint64_t value = 0;
+
+    for (int i = bytes - 1; i >= 0; i--)
+	value = (value << 8) | p[i];
+    return value;
+}
+
+#endif
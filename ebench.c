@@ -0,0 +1,546 @@
+/*
+ * ebench.c: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  benchmark the hot loops with hardware performance counters
+ *
+ *  each kernel is a copy of the inner loop of one of the programs:
+ *    search     emap's scan of the corpus for the next matching byte
+ *    gather     eunmap's walk of the corpus by distances
+ *    prefetch   the same walk in batches read by eparse_gather(), with
+ *               -prefetch N reads prefetched ahead
+ *    generator  ecorpus_next_token() for a corpus stream, one stream per
+ *               thread with -threads
+ *    histogram  etally's count of byte values
+ *
+ *  the bytes reported for the search are the corpus bytes scanned.
+ *
+ *  -sweep runs the search, gather and prefetch kernels on the first 1, 2,
+ *  4 ... megabytes of the corpus up to all of it, to show the gather
+ *  throughput against the corpus size.  The input should be long enough
+ *  to reach the end of the largest corpus.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "eperf.h"
+#include "ecorpus_tokens.h"
+#include "eparse.h"
+
+
+void
+fail(char *argv0)
+{
+    fprintf(stderr, "%s: run the program with two arguments\n", argv0);
+    fprintf(stderr, "  %s [ OPTIONS ] corpusfilename inputfilename\n", argv0);
+    fprintf(stderr, "  %s: use \"-kernel name\" to run one of search, gather, prefetch, generator or histogram\n", argv0);
+    fprintf(stderr, "  %s: use \"-stream stream:filename\" to run the generator on a corpus stream\n", argv0);
+    fprintf(stderr, "  %s: use \"-start N\" to start after the first N bytes of the corpus file\n", argv0);
+    fprintf(stderr, "  %s: use \"-threads N\" to run N generator streams at once\n", argv0);
+    fprintf(stderr, "  %s: use \"-prefetch N\" to prefetch N corpus reads ahead in the prefetch kernel\n", argv0);
+    fprintf(stderr, "  %s: use \"-sweep\" to run the gathers on growing parts of the corpus\n", argv0);
+    exit(1);
+}
+
+static unsigned char *
+map_file(char *argv0, char *filename, off_t *size)
+{
+    struct stat s;
+    unsigned char *data;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd == -1)
+    {
+	fprintf(stderr, "%s: cannot read the file: %s\n", argv0, filename);
+	fail(argv0);
+    }
+
+    fstat(fd, &s);
+    *size = s.st_size;
+    if (*size == 0)
+    {
+	fprintf(stderr, "%s: the file is empty: %s\n", argv0, filename);
+	fail(argv0);
+    }
+
+    data = (unsigned char *) mmap(0, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+	fprintf(stderr, "%s: cannot map the file: %s\n", argv0, filename);
+	exit(1);
+    }
+    close(fd);
+
+    return data;
+}
+
+/*
+ * emap's search - distances are saved for the gather kernel.
+ *  A negative distance is taken from the start after a wrap back to it.
+ *  Zero marks a byte which is not in the corpus.
+ */
+static unsigned long long
+kernel_search(unsigned char *corpus, off_t size_corpus, off_t start,
+	      unsigned char *input, off_t size_input, off_t *distances)
+{
+    off_t index_corpus = start;
+    unsigned long long scanned = 0;
+    bool wrapping = false;
+
+    for (off_t i = 0; i < size_input; )
+    {
+	unsigned char c = input[i];
+	off_t distance_corpus = -1;
+
+	for (off_t index_corpus2 = index_corpus + 1;
+	     index_corpus2 < size_corpus;
+	     index_corpus2++)
+	{
+	    if (c == corpus[index_corpus2] &&
+		c != (index_corpus2 - index_corpus))
+	    {
+		distance_corpus = index_corpus2 - index_corpus;
+		scanned += distance_corpus;
+		index_corpus = index_corpus2;
+		break;
+	    }
+	}
+
+	if (distance_corpus == -1)
+	{
+	    scanned += size_corpus - index_corpus;
+	    index_corpus = start;
+	    if (wrapping)	// not in the corpus - leave it out
+	    {
+		distances[i] = 0;
+		wrapping = false;
+		i++;
+		continue;
+	    }
+	    wrapping = true;
+	    continue;
+	}
+
+	distances[i] = wrapping ? -distance_corpus : distance_corpus;
+	wrapping = false;
+	i++;
+    }
+
+    return scanned;
+}
+
+/*
+ * eunmap's gather - the sum of the bytes keeps the loop from being removed
+ */
+static unsigned long long
+kernel_gather(unsigned char *corpus, off_t start, off_t *distances,
+	      off_t size_input, unsigned long long *sum)
+{
+    off_t index_corpus = start;
+
+    *sum = 0;
+    for (off_t i = 0; i < size_input; i++)
+    {
+	if (distances[i] <= 0)
+	{
+	    index_corpus = start;
+	    if (distances[i] == 0)
+		continue;
+	}
+	index_corpus += labs(distances[i]);
+	*sum += corpus[index_corpus];
+    }
+
+    return size_input;
+}
+
+/*
+ * eunmap's batched gather - the positions of EPARSE_BATCH bytes are
+ *  worked out and then read with prefetching
+ */
+static unsigned long long
+kernel_prefetch(unsigned char *corpus, off_t start, off_t *distances,
+		off_t size_input, size_t prefetch, unsigned long long *sum)
+{
+    off_t index_corpus = start;
+    off_t positions[EPARSE_BATCH];
+    unsigned char bytes[EPARSE_BATCH];
+
+    *sum = 0;
+    for (off_t i = 0; i < size_input; )
+    {
+	size_t n = 0;
+
+	for (; i < size_input && n < EPARSE_BATCH; i++)
+	{
+	    if (distances[i] <= 0)
+	    {
+		index_corpus = start;
+		if (distances[i] == 0)
+		    continue;
+	    }
+	    index_corpus += labs(distances[i]);
+	    positions[n++] = index_corpus;
+	}
+
+	eparse_gather(corpus, positions, n, bytes, prefetch);
+	for (size_t j = 0; j < n; j++)
+	    *sum += bytes[j];
+    }
+
+    return size_input;
+}
+
+/*
+ * the gathers on the first size_corpus bytes of the corpus
+ */
+static void
+sweep(unsigned char *corpus, off_t size_corpus, off_t start,
+      unsigned char *input, off_t size_input, off_t *distances,
+      size_t prefetch, struct eperf *perf)
+{
+    unsigned long long bytes;
+    unsigned long long sum;
+    char label[32];
+    char name[64];
+
+    kernel_search(corpus, size_corpus, start, input, size_input, distances);
+    kernel_gather(corpus, start, distances, size_input, &sum);	// fault in
+
+    eperf_start(perf);
+    bytes = kernel_gather(corpus, start, distances, size_input, &sum);
+    eperf_stop(perf);
+    snprintf(name, sizeof(name), "%-11s %6lluMB", "gather",
+	     (unsigned long long) size_corpus >> 20);
+    eperf_report(stdout, name, perf, bytes);
+
+    for (int i = 0; i < 2; i++)
+    {
+	size_t ahead = i == 0 ? 0 : prefetch;
+
+	eperf_start(perf);
+	bytes = kernel_prefetch(corpus, start, distances, size_input, ahead,
+				&sum);
+	eperf_stop(perf);
+	snprintf(label, sizeof(label), "prefetch %lu", (unsigned long) ahead);
+	snprintf(name, sizeof(name), "%-11s %6lluMB", label,
+		 (unsigned long long) size_corpus >> 20);
+	eperf_report(stdout, name, perf, bytes);
+    }
+}
+
+static unsigned long long
+kernel_generator(struct ecorpus_stream *generator, unsigned long long tokens,
+		 unsigned long long *sum)
+{
+    *sum = 0;
+    for (unsigned long long i = 0; i < tokens; i++)
+	*sum += ecorpus_next_token(generator);
+
+    return tokens;
+}
+
+struct generator_thread
+{
+    pthread_t thread;
+    struct ecorpus_stream *generator;
+    unsigned long long tokens;
+    unsigned long long sum;
+};
+
+static void *
+generator_worker(void *arg)
+{
+    struct generator_thread *work = (struct generator_thread *) arg;
+
+    kernel_generator(work->generator, work->tokens, &work->sum);
+    return NULL;
+}
+
+/*
+ * each thread drives its own stream - the streams share no state
+ */
+static unsigned long long
+kernel_generator_threads(struct generator_thread *work, int threads,
+			 unsigned long long *sum)
+{
+    unsigned long long tokens = 0;
+
+    for (int i = 0; i < threads; i++)
+	if (pthread_create(&work[i].thread, NULL, generator_worker, &work[i]) != 0)
+	{
+	    fprintf(stderr, "ebench: cannot create a generator thread\n");
+	    exit(1);
+	}
+
+    *sum = 0;
+    for (int i = 0; i < threads; i++)
+    {
+	pthread_join(work[i].thread, NULL);
+	*sum += work[i].sum;
+	tokens += work[i].tokens;
+    }
+
+    return tokens;
+}
+
+static unsigned long long
+kernel_histogram(unsigned char *data, off_t size, int *bytes)
+{
+    for (int i = 0; i < 256; i++)
+	bytes[i] = 0;
+
+    for (off_t i = 0; i < size; i++)
+	bytes[data[i]]++;
+
+    return size;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned char *corpus;
+    unsigned char *input;
+    off_t size_corpus;
+    off_t size_input;
+    off_t *distances;
+    unsigned long start = 0;
+    char *kernel = NULL;
+    char *stream = NULL;
+    int threads = 1;
+    size_t prefetch = EPARSE_PREFETCH;
+    bool sweeping = false;
+    struct eperf perf;
+    unsigned long long bytes;
+    unsigned long long sum;
+    int counts[256];
+
+    char *args[3] = { "", "", "" };
+    int argsc = 1;
+
+    /*
+     * parse the arguments to the program
+     */
+    args[0] = argv[0];
+    for (unsigned int i = 1; i < argc; i++)
+    {
+	if (strcmp(argv[i], "-kernel") == 0 || strcmp(argv[i], "-stream") == 0)
+	{
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no %s value given\n", argv[0], argv[i]);
+		fail(argv[0]);
+	    }
+
+	    if (strcmp(argv[i], "-kernel") == 0)
+		kernel = argv[i + 1];
+	    else
+		stream = argv[i + 1];
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-start") == 0)
+	{
+	    unsigned int rvalue;
+	    unsigned long scan_token;
+
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -start value given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    rvalue = sscanf(argv[i + 1], "%lu", &scan_token);
+	    if (rvalue == 0 || rvalue == EOF || scan_token > UINT_MAX)
+	    {
+		fprintf(stderr, "%s: -start value (%s) is not an integer in the range of 0 to %u\n",
+			argv[0], argv[i + 1], UINT_MAX);
+		fail(argv[0]);
+	    }
+
+	    start = scan_token;
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-threads") == 0)
+	{
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -threads value given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    if (sscanf(argv[i + 1], "%d", &threads) != 1 || threads < 1 ||
+		threads > 256)
+	    {
+		fprintf(stderr, "%s: -threads value (%s) is not an integer in the range of 1 to 256\n",
+			argv[0], argv[i + 1]);
+		fail(argv[0]);
+	    }
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-prefetch") == 0)
+	{
+	    unsigned long scan_token;
+
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -prefetch value given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    if (sscanf(argv[i + 1], "%lu", &scan_token) != 1 ||
+		scan_token >= EPARSE_BATCH)
+	    {
+		fprintf(stderr, "%s: -prefetch value (%s) is not an integer in the range of 0 to %d\n",
+			argv[0], argv[i + 1], EPARSE_BATCH - 1);
+		fail(argv[0]);
+	    }
+	    prefetch = scan_token;
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-sweep") == 0)
+	{
+	    sweeping = true;
+	    continue;
+	}
+
+	if (argsc >= 3)
+	    fail(args[0]);
+	args[argsc] = argv[i];
+	argsc++;
+    }
+
+    if (argsc != 3)
+	fail(args[0]);
+
+    corpus = map_file(args[0], args[1], &size_corpus);
+    input = map_file(args[0], args[2], &size_input);
+
+    if (start >= size_corpus)
+    {
+	fprintf(stderr, "%s: -start is past the end of the corpus\n", args[0]);
+	fail(args[0]);
+    }
+
+    distances = (off_t *) malloc(size_input * sizeof(off_t));
+    if (distances == NULL)
+    {
+	fprintf(stderr, "%s: out of memory\n", args[0]);
+	exit(1);
+    }
+
+    eperf_open(&perf);
+    if (eperf_available(&perf, EPERF_CYCLES) == false)
+	fprintf(stderr, "%s: hardware counters are not available - check /proc/sys/kernel/perf_event_paranoid\n",
+		args[0]);
+
+    if (sweeping)
+    {
+	for (off_t size = 1024 * 1024; ; size *= 2)
+	{
+	    if (size > size_corpus)
+		size = size_corpus;
+	    if (size > (off_t) start)
+		sweep(corpus, size, start, input, size_input, distances,
+		      prefetch, &perf);
+	    if (size == size_corpus)
+		break;
+	}
+	eperf_close(&perf);
+	return 0;
+    }
+
+    /*
+     * the search always runs - the gather needs its distances
+     */
+    eperf_start(&perf);
+    bytes = kernel_search(corpus, size_corpus, start, input, size_input,
+			  distances);
+    eperf_stop(&perf);
+    if (kernel == NULL || strcmp(kernel, "search") == 0)
+	eperf_report(stdout, "search", &perf, bytes);
+
+    if (kernel == NULL || strcmp(kernel, "gather") == 0)
+    {
+	eperf_start(&perf);
+	bytes = kernel_gather(corpus, start, distances, size_input, &sum);
+	eperf_stop(&perf);
+	eperf_report(stdout, "gather", &perf, bytes);
+    }
+
+    if (kernel == NULL || strcmp(kernel, "prefetch") == 0)
+    {
+	eperf_start(&perf);
+	bytes = kernel_prefetch(corpus, start, distances, size_input, prefetch,
+				&sum);
+	eperf_stop(&perf);
+	eperf_report(stdout, "prefetch", &perf, bytes);
+    }
+
+    if (stream != NULL && (kernel == NULL || strcmp(kernel, "generator") == 0))
+    {
+	struct generator_thread work[threads];
+
+	for (int i = 0; i < threads; i++)
+	{
+	    work[i].generator = ecorpus_tokens_open(args[0], stream);
+	    work[i].tokens = size_corpus;
+	}
+
+	eperf_start(&perf);
+	if (threads == 1)
+	    bytes = kernel_generator(work[0].generator, size_corpus, &sum);
+	else
+	    bytes = kernel_generator_threads(work, threads, &sum);
+	eperf_stop(&perf);
+	eperf_report(stdout, "generator", &perf, bytes);
+
+	for (int i = 0; i < threads; i++)
+	    ecorpus_tokens_close(work[i].generator);
+    }
+
+    if (kernel == NULL || strcmp(kernel, "histogram") == 0)
+    {
+	eperf_start(&perf);
+	bytes = kernel_histogram(corpus, size_corpus, counts);
+	eperf_stop(&perf);
+	eperf_report(stdout, "histogram", &perf, bytes);
+    }
+
+    eperf_close(&perf);
+
+    return 0;
+}
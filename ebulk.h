@@ -0,0 +1,183 @@
+/*
+ * ebulk.h: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  the bulk generator engine - "-engine bulk" for corpus files and streams
+ *
+ *  xoshiro256** runs in EBULK_LANES lanes at once with GCC vector types,
+ *  so the compiler emits SIMD shifts, adds and xors.  Every bit of the
+ *  output is used: a buffer of random bytes is filled at a time.  When a
+ *  byte list is given the bytes not in the list are removed from the
+ *  whole buffer as it is filled - rather than one retry per token.
+ *
+ *  the output differs from the random() engine, so a corpus must be made
+ *  again with the same engine to be decrypted.
+ */
+#ifndef EBULK_H
+#define EBULK_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define EBULK_LANES 4
+#define EBULK_BUFFER 4096	// a multiple of 8 * EBULK_LANES
+
+typedef uint64_t ebulk_lanes __attribute__ ((vector_size (8 * EBULK_LANES)));
+
+/*
+ * a position in the output - the state before the last buffer was filled
+ *  and the next byte in that buffer
+ */
+struct ebulk_mark
+{
+    uint64_t s[4][EBULK_LANES];
+    int next;
+};
+
+struct ebulk
+{
+    uint64_t s[4][EBULK_LANES];
+    struct ebulk_mark mark;
+    const int *keep;		// bytes to keep - all when NULL
+    int size;
+    unsigned char buffer[EBULK_BUFFER];
+};
+
+static inline uint64_t
+ebulk_splitmix(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// a macro - vector arguments would change the ABI without -mavx
+#define EBULK_ROTL(x, k) (((x) << (k)) | ((x) >> (64 - (k))))
+
+/*
+ * fill the buffer - the lanes are interleaved in the output
+ */
+static inline void
+ebulk_fill(struct ebulk *g)
+{
+    ebulk_lanes s0, s1, s2, s3;
+
+    do
+    {
+	memcpy(g->mark.s, g->s, sizeof(g->s));
+	memcpy(&s0, g->s[0], sizeof(s0));
+	memcpy(&s1, g->s[1], sizeof(s1));
+	memcpy(&s2, g->s[2], sizeof(s2));
+	memcpy(&s3, g->s[3], sizeof(s3));
+
+	for (int i = 0; i < EBULK_BUFFER; i += sizeof(ebulk_lanes))
+	{
+	    ebulk_lanes x = s1 + (s1 << 2);	// s1 * 5
+	    ebulk_lanes t = s1 << 17;
+
+	    x = EBULK_ROTL(x, 7);
+	    x = x + (x << 3);			// * 9
+	    memcpy(g->buffer + i, &x, sizeof(x));
+
+	    s2 ^= s0;
+	    s3 ^= s1;
+	    s1 ^= s2;
+	    s0 ^= s3;
+	    s2 ^= t;
+	    s3 = EBULK_ROTL(s3, 45);
+	}
+
+	memcpy(g->s[0], &s0, sizeof(s0));
+	memcpy(g->s[1], &s1, sizeof(s1));
+	memcpy(g->s[2], &s2, sizeof(s2));
+	memcpy(g->s[3], &s3, sizeof(s3));
+
+	g->size = EBULK_BUFFER;
+	if (g->keep != NULL)
+	{
+	    int n = 0;
+
+	    for (int i = 0; i < EBULK_BUFFER; i++)
+	    {
+		unsigned char b = g->buffer[i];
+
+		g->buffer[n] = b;
+		n += (g->keep[b] != 0);
+	    }
+	    g->size = n;
+	}
+    } while (g->size == 0);
+
+    g->mark.next = 0;
+}
+
+static inline void
+ebulk_init(struct ebulk *g, uint64_t key, const int *keep)
+{
+    for (int i = 0; i < 4; i++)
+	for (int j = 0; j < EBULK_LANES; j++)
+	    g->s[i][j] = ebulk_splitmix(&key);
+    g->keep = keep;
+    ebulk_fill(g);
+}
+
+static inline unsigned char
+ebulk_byte(struct ebulk *g)
+{
+    if (g->mark.next == g->size)
+	ebulk_fill(g);
+    return g->buffer[g->mark.next++];
+}
+
+static inline void
+ebulk_skip(struct ebulk *g, unsigned long count)
+{
+    while (count > 0)
+    {
+	unsigned long left = g->size - g->mark.next;
+
+	if (left == 0)
+	{
+	    ebulk_fill(g);
+	    continue;
+	}
+	if (left > count)
+	    left = count;
+	g->mark.next += left;
+	count -= left;
+    }
+}
+
+/*
+ * return to a saved position
+ */
+static inline void
+ebulk_restore(struct ebulk *g, const struct ebulk_mark *mark)
+{
+    memcpy(g->s, mark->s, sizeof(g->s));
+    ebulk_fill(g);
+    g->mark.next = mark->next;
+}
+
+#endif
@@ -0,0 +1,254 @@
+/*
+ * ecompress.c: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  the compression threads - see ecompress.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "ecompress.h"
+
+#define ECOMPRESS_BUFFER 65536
+#define ECOMPRESS_GZIP (15 + 16)	// zlib window bits for a gzip stream
+
+struct ecompress
+{
+    pthread_t thread;
+    char *argv0;
+    FILE *fp_plain;		// the plaintext side - read or written
+    FILE *fp_compressed;	// the thread's end of the pipe
+    int level;
+    bool failed;
+};
+
+/*
+ * read the plaintext and write it compressed into the pipe
+ */
+static void *
+compress_thread(void *arg)
+{
+    struct ecompress *codec = (struct ecompress *) arg;
+    unsigned char *in = malloc(ECOMPRESS_BUFFER);
+    unsigned char *out = malloc(ECOMPRESS_BUFFER);
+    z_stream z;
+    int flush;
+
+    memset(&z, 0, sizeof(z));
+    if (in == NULL || out == NULL ||
+	deflateInit2(&z, codec->level, Z_DEFLATED, ECOMPRESS_GZIP, 8,
+		     Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+	fprintf(stderr, "%s: cannot start the compression\n", codec->argv0);
+	codec->failed = true;
+	fclose(codec->fp_compressed);
+	free(in);
+	free(out);
+	return NULL;
+    }
+
+    do
+    {
+	z.next_in = in;
+	z.avail_in = fread(in, 1, ECOMPRESS_BUFFER, codec->fp_plain);
+	if (ferror(codec->fp_plain))
+	{
+	    fprintf(stderr, "%s: cannot read the input to compress\n",
+		    codec->argv0);
+	    codec->failed = true;
+	    break;
+	}
+	flush = feof(codec->fp_plain) ? Z_FINISH : Z_NO_FLUSH;
+
+	do
+	{
+	    z.next_out = out;
+	    z.avail_out = ECOMPRESS_BUFFER;
+	    if (deflate(&z, flush) == Z_STREAM_ERROR ||
+		fwrite(out, 1, ECOMPRESS_BUFFER - z.avail_out,
+		       codec->fp_compressed) != ECOMPRESS_BUFFER - z.avail_out)
+	    {
+		fprintf(stderr, "%s: cannot write the compressed input\n",
+			codec->argv0);
+		codec->failed = true;
+		break;
+	    }
+	} while (z.avail_out == 0);
+    } while (flush != Z_FINISH && codec->failed == false);
+
+    deflateEnd(&z);
+    if (fclose(codec->fp_compressed) != 0)
+	codec->failed = true;
+    free(in);
+    free(out);
+
+    return NULL;
+}
+
+/*
+ * read the compressed stream from the pipe and write the plaintext
+ */
+static void *
+decompress_thread(void *arg)
+{
+    struct ecompress *codec = (struct ecompress *) arg;
+    unsigned char *in = malloc(ECOMPRESS_BUFFER);
+    unsigned char *out = malloc(ECOMPRESS_BUFFER);
+    z_stream z;
+    int status = Z_OK;
+
+    memset(&z, 0, sizeof(z));
+    if (in == NULL || out == NULL ||
+	inflateInit2(&z, ECOMPRESS_GZIP) != Z_OK)
+    {
+	fprintf(stderr, "%s: cannot start the decompression\n", codec->argv0);
+	codec->failed = true;
+	fclose(codec->fp_compressed);
+	free(in);
+	free(out);
+	return NULL;
+    }
+
+    while (status != Z_STREAM_END)
+    {
+	z.next_in = in;
+	z.avail_in = fread(in, 1, ECOMPRESS_BUFFER, codec->fp_compressed);
+	if (z.avail_in == 0)
+	    break;
+
+	do
+	{
+	    z.next_out = out;
+	    z.avail_out = ECOMPRESS_BUFFER;
+	    status = inflate(&z, Z_NO_FLUSH);
+	    if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR)
+		break;
+	    if (fwrite(out, 1, ECOMPRESS_BUFFER - z.avail_out, codec->fp_plain) !=
+		ECOMPRESS_BUFFER - z.avail_out)
+	    {
+		codec->failed = true;
+		break;
+	    }
+	} while (z.avail_out == 0 && status != Z_STREAM_END);
+
+	if (codec->failed ||
+	    (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR))
+	    break;
+    }
+
+    if (codec->failed || fflush(codec->fp_plain) != 0)
+    {
+	fprintf(stderr, "%s: cannot write the decompressed output\n",
+		codec->argv0);
+	codec->failed = true;
+    }
+    else if (status != Z_STREAM_END)
+    {
+	fprintf(stderr, "%s: the decrypted data is not a whole compressed stream\n",
+		codec->argv0);
+	codec->failed = true;
+    }
+
+    // drain the pipe so the writer is never blocked
+    while (fread(in, 1, ECOMPRESS_BUFFER, codec->fp_compressed) > 0)
+	;
+
+    inflateEnd(&z);
+    fclose(codec->fp_compressed);
+    free(in);
+    free(out);
+
+    return NULL;
+}
+
+static struct ecompress *
+codec_start(char *argv0, FILE *fp_plain, int level, FILE **fp_compressed,
+	    void *(*thread)(void *))
+{
+    struct ecompress *codec;
+    int fds[2];
+    bool compress = thread == compress_thread;
+
+    codec = (struct ecompress *) calloc(1, sizeof(struct ecompress));
+    if (codec == NULL || pipe(fds) != 0)
+    {
+	fprintf(stderr, "%s: cannot create the compression pipe\n", argv0);
+	exit(1);
+    }
+    codec->argv0 = argv0;
+    codec->fp_plain = fp_plain;
+    codec->level = level;
+
+    // the compressor writes the pipe and the decompressor reads it
+    codec->fp_compressed = fdopen(fds[compress ? 1 : 0], compress ? "w" : "r");
+    *fp_compressed = fdopen(fds[compress ? 0 : 1], compress ? "r" : "w");
+    if (codec->fp_compressed == NULL || *fp_compressed == NULL)
+    {
+	fprintf(stderr, "%s: cannot create the compression pipe\n", argv0);
+	exit(1);
+    }
+
+    if (pthread_create(&codec->thread, NULL, thread, codec) != 0)
+    {
+	fprintf(stderr, "%s: cannot create the compression thread\n", argv0);
+	exit(1);
+    }
+
+    return codec;
+}
+
+/*
+ * compress fp_plain on a thread - the caller reads *fp_compressed
+ */
+struct ecompress *
+ecompress_start(char *argv0, FILE *fp_plain, int level, FILE **fp_compressed)
+{
+    return codec_start(argv0, fp_plain, level, fp_compressed, compress_thread);
+}
+
+/*
+ * decompress into fp_plain on a thread - the caller writes and closes
+ *  *fp_compressed
+ */
+struct ecompress *
+edecompress_start(char *argv0, FILE *fp_plain, FILE **fp_compressed)
+{
+    return codec_start(argv0, fp_plain, 0, fp_compressed, decompress_thread);
+}
+
+/*
+ * wait for the thread - false if the stream was not whole
+ */
+bool
+ecompress_finish(struct ecompress *codec)
+{
+    bool ok;
+
+    pthread_join(codec->thread, NULL);
+    ok = codec->failed == false;
+    free(codec);
+
+    return ok;
+}
@@ -0,0 +1,48 @@
+/*
+ * ecompress.h: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  compression before emap and decompression after eunmap
+ *
+ *  every plaintext byte costs a corpus search and at least one byte of
+ *  ciphertext, so compressing first makes both smaller.  The codec runs
+ *  on its own thread and talks to the encode or decode loop through a
+ *  pipe: the loops read and write a FILE as they always have.  The
+ *  stream is gzip so the plaintext can also be recovered with gunzip.
+ */
+#ifndef ECOMPRESS_H
+#define ECOMPRESS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#define ECOMPRESS_LEVEL 1	// fastest
+
+struct ecompress;
+
+extern struct ecompress *ecompress_start(char *argv0, FILE *fp_plain,
+					 int level, FILE **fp_compressed);
+extern struct ecompress *edecompress_start(char *argv0, FILE *fp_plain,
+					   FILE **fp_compressed);
+extern bool ecompress_finish(struct ecompress *codec);
+
+#endif
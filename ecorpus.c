@@ -32,6 +32,12 @@ SOFTWARE.
 #include <limits.h>
 #include <stdbool.h>
 #include <math.h>
+#include <stdint.h>
+#include <sys/wait.h>
+#include "estats.h"
+#include "ebulk.h"
+#include "ekey.h"
+#include "eweights.h"
 
 long int prandom(void)
 {
@@ -61,7 +67,11 @@ fail(char *argv0)
     fprintf(stderr, "  -corpus_size set the size of the file to be created: -corpus_size number\n");
     fprintf(stderr, "  -uniform sets byte values per block to be uniform and random\n");
     fprintf(stderr, "  -key sets the randomizing seed: -key number\n");
+    fprintf(stderr, "  -count make N corpus files from one key - filename1 to filenameN: -count number\n");
+    fprintf(stderr, "  -threads make up to N of the -count corpus files at once: -threads number\n");
     fprintf(stderr, "  -byte_list file containing byte values for the corpus: -byte_list file\n");
+    fprintf(stderr, "  -weighted match the byte frequencies of the -byte_list file\n");
+    fprintf(stderr, "  -engine random number generator: -engine random or -engine bulk\n");
     fprintf(stderr, "  -start_skip skip the first N random numbers: -start_skip number\n");
     fprintf(stderr, "  -skip skip N numbers on each call to random: -skip number\n");
     fprintf(stderr, "  -skip_random skip randomly at each call to random()\n");
@@ -69,16 +79,21 @@ fail(char *argv0)
     fprintf(stderr, "  -filter_file file of skip N numbers: -filter_file filename\n");
     fprintf(stderr, "  -filter_skip bytes to skip in the filter file: -filter_skip number\n");
     fprintf(stderr, "  -filter_mask mask to be used for skip numbers: -filter_mask number\n");
+    fprintf(stderr, "  -stats report counters on standard error: -stats or -stats_json\n");
     fprintf(stderr, "\n");
     exit(1);
 }
 
-static void coverage(char *args0, int bytes_count, int *bytes, int *counts, int count);
+static void coverage(char *args0, int bytes_count, int *bytes, int *counts, int count,
+		     bool weighted);
+static unsigned int corpora(char *argv0, char *filename, unsigned int count,
+			    unsigned int threads, uint64_t master, FILE **fp_corpus);
 
 int main(int argc, char **argv)
 {
     unsigned int rvalue;
     FILE *fp_corpus = NULL;
+    char *corpus_filename = NULL;
     unsigned int corpus_size = 0;
     unsigned long scan_token;
     int counts[256];
@@ -86,19 +101,33 @@ int main(int argc, char **argv)
     int bytes_count;
     int uniform_byte_counts[256];
     int uniform_byte_count;
+    int uniform_block_size;
+    static unsigned char weights_table[EWEIGHTS_BLOCK + 256];
+    unsigned int weights_total = 0;
     unsigned char token;
     unsigned char c;
     // options
     bool uniform = false;
     time_t key = 0;
+    unsigned int count = 0;
+    unsigned int threads = 0;
     unsigned long start_skip = 0;
     FILE *fp_byte_list = NULL;
+    bool weighted = false;
     unsigned long skip = 0;
     bool skip_random = false;
     unsigned char skip_random_mask = 0377;
     FILE *fp_filter = NULL;
+    char *filter_filename = NULL;
     unsigned long filter_skip = 0;
     unsigned char filter_mask = 0377;
+    bool stats = false;
+    bool stats_json = false;
+    bool bulk = false;
+    static struct ebulk bulk_tokens;
+    static struct ebulk bulk_skips;
+
+    ESTATS_PHASE(ESTATS_SETUP);
 
     /*
      * parse the options to the program
@@ -113,13 +142,7 @@ int main(int argc, char **argv)
 		fail(argv[0]);
 	    }
 
-	    fp_corpus = fopen(argv[i + 1], "w");
-	    if (fp_corpus == NULL)
-	    {
-		fprintf(stderr, "%s: cannot open the corpus: %s\n",
-			argv[0], argv[i + 1]);
-		fail(argv[0]);
-	    }
+	    corpus_filename = argv[i + 1];
 	    i++;
 	    continue;
 	}
@@ -172,6 +195,48 @@ int main(int argc, char **argv)
 	    continue;
 	}
 
+	if (strcmp(argv[i], "-count") == 0)
+	{
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -count value given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    rvalue = sscanf(argv[i + 1], "%lu", &scan_token);
+	    if (rvalue == 0 || rvalue == EOF || scan_token < 1 || scan_token > 1000000)
+	    {
+		fprintf(stderr, "%s: -count value (%s) is not an integer in the range of 1 to 1000000\n",
+			argv[0], argv[i + 1]);
+		fail(argv[0]);
+	    }
+
+	    count = scan_token;
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-threads") == 0)
+	{
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -threads value given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    rvalue = sscanf(argv[i + 1], "%lu", &scan_token);
+	    if (rvalue == 0 || rvalue == EOF || scan_token < 1 || scan_token > 1024)
+	    {
+		fprintf(stderr, "%s: -threads value (%s) is not an integer in the range of 1 to 1024\n",
+			argv[0], argv[i + 1]);
+		fail(argv[0]);
+	    }
+
+	    threads = scan_token;
+	    i++;
+	    continue;
+	}
+
 	if (strcmp(argv[i], "-start_skip") == 0)
 	{
 	    if  (argc <= i + 1)
@@ -212,6 +277,32 @@ int main(int argc, char **argv)
 	    continue;
 	}
 
+	if (strcmp(argv[i], "-weighted") == 0)
+	{
+	    weighted = true;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-engine") == 0)
+	{
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -engine name given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    if (strcmp(argv[i + 1], "bulk") == 0)
+		bulk = true;
+	    else if (strcmp(argv[i + 1], "random") != 0)
+	    {
+		fprintf(stderr, "%s: -engine (%s) is not random or bulk\n",
+			argv[0], argv[i + 1]);
+		fail(argv[0]);
+	    }
+	    i++;
+	    continue;
+	}
+
 	if (strcmp(argv[i], "-skip") == 0)
 	{
 	    if  (argc <= i + 1)
@@ -279,6 +370,7 @@ int main(int argc, char **argv)
 		fail(argv[0]);
 	    }
 
+	    filter_filename = argv[i + 1];
 	    fp_filter = fopen(argv[i + 1], "r");
 	    if (fp_filter == NULL)
 	    {
@@ -343,10 +435,27 @@ int main(int argc, char **argv)
 	    continue;
 	}
 
+	if (strcmp(argv[i], "-stats") == 0)
+	{
+	    stats = true;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-stats_json") == 0)
+	{
+	    stats = true;
+	    stats_json = true;
+	    continue;
+	}
+
 	fprintf(stderr, "%s: argument needs fixing: \"%s\"\n", argv[0], argv[i]);
 	fail(argv[0]);
     }
 
+    if (stats && ESTATS_ENABLED == 0)
+	fprintf(stderr, "%s: -stats needs a build with the counters: make stats\n",
+		argv[0]);
+
     if (uniform == true)
 	fprintf(stdout, "uniform blocks enabled\n");
 
@@ -356,6 +465,19 @@ int main(int argc, char **argv)
     if (fp_byte_list != NULL)
 	fprintf(stdout, "byte_list provided\n");
 
+    if (weighted == true)
+    {
+	if (fp_byte_list == NULL)
+	{
+	    fprintf(stderr, "%s: -weighted needs a -byte_list file\n", argv[0]);
+	    fail(argv[0]);
+	}
+	fprintf(stdout, "weighted byte_list enabled\n");
+    }
+
+    if (bulk == true)
+	fprintf(stdout, "bulk engine enabled\n");
+
     if (start_skip != 0)
 	fprintf(stdout, "start_skip provided\n");
 
@@ -387,17 +509,31 @@ int main(int argc, char **argv)
 	    bytes[c]++;
 
 	    /*
-	     * optional speed up - remove if balancing byte proportions
+	     * optional speed up - the weighted list needs every count
 	     */
 	    if(bytes[c] == 1)
 		bytes_count++;
-	    if (bytes_count == 256)
+	    if (bytes_count == 256 && weighted == false)
 		break;
 	}
 
 	fclose(fp_byte_list);
 
 	fprintf(stdout, "unique bytes count = %d\n", bytes_count);
+
+	/*
+	 * bytes[] is the count of each byte value in a uniform block
+	 */
+	if (weighted)
+	{
+	    weights_total = eweights_build(bytes, weights_table);
+	    fprintf(stdout, "weighted block size = %u\n", weights_total);
+	}
+	else
+	{
+	    for (int i = 0; i < 256; i++)
+		bytes[i] = (bytes[i] != 0);
+	}
     }
     else
     {
@@ -407,6 +543,48 @@ int main(int argc, char **argv)
 	bytes_count = 256;
     }
 
+    uniform_block_size = 0;
+    for (int i = 0; i < 256; i++)
+	uniform_block_size += bytes[i];
+
+    if (corpus_filename == NULL || corpus_size == 0)
+    {
+	fprintf(stderr, "%s: -corpus and -corpus_size must both be set\n", argv[0]);
+	fail(argv[0]);
+    }
+
+    /*
+     * seed the random number generator - with -count each corpus is made
+     *  by a child process from a key derived from the master key
+     */
+    if (count > 0)
+    {
+	key = corpora(argv[0], corpus_filename, count, threads,
+		      key != 0 ? (uint64_t) key : ekey_random(), &fp_corpus);
+
+	// read the filter file from an offset of its own
+	if (fp_filter != NULL &&
+	    (fp_filter = freopen(filter_filename, "r", fp_filter)) == NULL)
+	{
+	    fprintf(stderr, "%s: cannot open the filter file: %s\n",
+		    argv[0], filter_filename);
+	    exit(1);
+	}
+    }
+    else
+    {
+	fp_corpus = fopen(corpus_filename, "w");
+	if (fp_corpus == NULL)
+	{
+	    fprintf(stderr, "%s: cannot open the corpus: %s\n",
+		    argv[0], corpus_filename);
+	    fail(argv[0]);
+	}
+
+	if (key == 0)
+	    key = ekey_derive(ekey_random(), 0);
+    }
+
     /*
      * advance the filter_file the filter_skip byte count
      */
@@ -426,21 +604,18 @@ int main(int argc, char **argv)
 	}
     }
 
-    if (fp_corpus == NULL || corpus_size == 0)
-    {
-	fprintf(stderr, "%s: -corpus and -corpus_size must both be set\n", argv[0]);
-	fail(argv[0]);
-    }
-    
+    psrandom((unsigned int) key);
+
     /*
-     * seed the random number generator
+     * the bulk engine drops the bytes not in the byte list a buffer at a
+     *  time.  -skip_random draws from a second generator.
      */
-    if (key == 0)
+    if (bulk)
     {
-	sleep(1);  // make back to back corpuses differ
-	key = time(NULL);
+	ebulk_init(&bulk_tokens, key,
+		   (bytes_count < 256 && weighted == false) ? bytes : NULL);
+	ebulk_init(&bulk_skips, key ^ 0x736b6970, NULL);
     }
-    psrandom((unsigned int) key);
 
     /*
      * clear the tabulation arrays
@@ -455,12 +630,18 @@ int main(int argc, char **argv)
     /*
      * generate - all of the stuff above is fluff
      */
+    ESTATS_PHASE(ESTATS_SEEK);
     if (skip_random)
-	start_skip += prandom() & skip_random_mask;
+	start_skip += (bulk ? ebulk_byte(&bulk_skips) : prandom()) &
+	    skip_random_mask;
 
-    for (unsigned int j = 0; j < start_skip; j++)
-	token = prandom();
+    if (bulk)
+	ebulk_skip(&bulk_tokens, start_skip);
+    else
+	for (unsigned int j = 0; j < start_skip; j++)
+	    token = prandom();
 
+    ESTATS_PHASE(ESTATS_LOOP);
     for (unsigned int i = 0; i < corpus_size; )
     {
 	unsigned long skipr = 0;
@@ -481,31 +662,56 @@ int main(int argc, char **argv)
 
 
 	if (skip_random)
-	    skipr = prandom() & skip_random_mask;
+	    skipr = (bulk ? ebulk_byte(&bulk_skips) : prandom()) &
+		skip_random_mask;
 
 	skipr = skipr + skipf + skip;
 
-	for (unsigned int j = 0; j < skipr; j++)
-	    token = prandom();
+	if (bulk)
+	    ebulk_skip(&bulk_tokens, skipr);
+	else
+	    for (unsigned int j = 0; j < skipr; j++)
+		token = prandom();
+	ESTATS_ADD(skip_calls, skipr);
 
-	token = prandom() & 0377;
+	if (bulk && weighted)
+	{
+	    unsigned int r = ebulk_byte(&bulk_tokens);
+
+	    r = (r << 8) | ebulk_byte(&bulk_tokens);
+	    token = weights_table[r % weights_total];
+	}
+	else if (bulk)
+	    token = ebulk_byte(&bulk_tokens);
+	else if (weighted)
+	    token = weights_table[prandom() % weights_total];
+	else
+	    token = prandom() & 0377;
 
 	if (bytes[token] == 0)
+	{
+	    ESTATS_ADD(byte_list_retries, 1);
 	    continue;
+	}
 
-	if(uniform && uniform_byte_counts[token] != 0)
+	if(uniform && uniform_byte_counts[token] >= bytes[token])
+	{
+	    ESTATS_ADD(uniform_retries, 1);
 	    continue;
+	}
 
 	fputc(token, fp_corpus);
 	i++;
 	counts[token]++;
+	ESTATS_ADD(tokens_generated, 1);
+	ESTATS_ADD(output_bytes, 1);
 
 	if(uniform)
 	{
-	    uniform_byte_counts[token] = 1;
+	    uniform_byte_counts[token]++;
 	    uniform_byte_count++;
 
-	    if (uniform_byte_count == bytes_count)
+	    if (uniform_byte_count == uniform_block_size)
 	    {
 		uniform_byte_count = 0;
 		for (int j = 0; j < 256; j++)
@@ -516,13 +722,87 @@ int main(int argc, char **argv)
 
     fclose(fp_corpus);
 
-    coverage(argv[0], bytes_count, bytes, counts, corpus_size);
+    if (stats)
+	ESTATS_REPORT(stderr, argv[0], stats_json);
+
+    coverage(argv[0], bytes_count, bytes, counts, corpus_size, weighted);
 
     return 0;
 }
 
+/*
+ * make count corpus files - filename1 to filenameN - up to threads of
+ *  them at once.  Each file is generated by a child process: corpora()
+ *  returns in the child with the key of its corpus and the file open.
+ *  The parent exits when the children are done.
+ */
+static unsigned int
+corpora(char *argv0, char *filename, unsigned int count, unsigned int threads,
+	uint64_t master, FILE **fp_corpus)
+{
+    char name[PATH_MAX];
+    unsigned int running = 0;
+    bool failed = false;
+    int status;
+    pid_t pid;
+
+    if (threads == 0)
+	threads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ?
+	    sysconf(_SC_NPROCESSORS_ONLN) : 1;
+
+    fflush(stdout);
+    for (unsigned int i = 0; i < count && failed == false; i++)
+    {
+	if (running == threads)
+	{
+	    if (wait(&status) > 0 &&
+		(WIFEXITED(status) == 0 || WEXITSTATUS(status) != 0))
+		failed = true;
+	    running--;
+	}
+
+	snprintf(name, sizeof(name), "%s%u", filename, i + 1);
+	*fp_corpus = fopen(name, "w");
+	if (*fp_corpus == NULL)
+	{
+	    fprintf(stderr, "%s: cannot open the corpus: %s\n", argv0, name);
+	    failed = true;
+	    break;
+	}
+
+	pid = fork();
+	if (pid == 0)
+	{
+	    // the report of each corpus is written in one piece at exit
+	    setvbuf(stdout, NULL, _IOFBF, BUFSIZ);
+	    fprintf(stdout, "\ncorpus %s\n", name);
+	    return ekey_derive(master, i);
+	}
+
+	fclose(*fp_corpus);
+	if (pid < 0)
+	{
+	    fprintf(stderr, "%s: cannot start a process for the corpus: %s\n",
+		    argv0, name);
+	    failed = true;
+	    break;
+	}
+	running++;
+    }
+
+    for (; running > 0; running--)
+    {
+	if (wait(&status) > 0 &&
+	    (WIFEXITED(status) == 0 || WEXITSTATUS(status) != 0))
+	    failed = true;
+    }
+
+    exit(failed ? 1 : 0);
+}
+
 static void
-coverage(char *args0, int bytes_count, int *bytes, int *counts, int count)
+coverage(char *args0, int bytes_count, int *bytes, int *counts, int count,
+	 bool weighted)
 {
     /*
      * check the data coverage and uniformity
@@ -546,8 +826,14 @@ coverage(char *args0, int bytes_count, int *bytes, int *counts, int count)
     }
 
     /*
-     * check the data uniformity
+     * check the data uniformity - weighted corpora are not uniform
      */
+    if (weighted)
+    {
+	fprintf(stdout, "byte counts follow the byte_list weights\n");
+	return;
+    }
+
     for (int i = 0; i < 256; i++)
     {
 	if (bytes[i] == 0)
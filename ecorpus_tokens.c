@@ -32,24 +32,14 @@ SOFTWARE.
 #include <limits.h>
 #include <stdbool.h>
 #include <math.h>
-
-static long int prandom(void)
-{
-#ifdef __STRICT_ANSI__
-    return rand();
-#else
-    return random();
-#endif
-}
-
-static void psrandom(unsigned int key)
-{
-#ifdef __STRICT_ANSI__
-    srand(key)
-#else
-    srandom(key);
-#endif
-}
+#include <pthread.h>
+#include "estats.h"
+#include "ebulk.h"
+#include "ekey.h"
+#include "eweights.h"
+#include "efingerprint.h"
+#include "ewait.h"
+#include "ecorpus_tokens.h"
 
 static void
 sub_fail(char *argv0)
@@ -58,6 +48,8 @@ sub_fail(char *argv0)
     fprintf(stderr, "  -uniform sets byte values per block to be uniform and random\n");
     fprintf(stderr, "  -key sets the randomizing seed: -key number\n");
     fprintf(stderr, "  -byte_list file containing byte values for the corpus: -byte_list file\n");
+    fprintf(stderr, "  -weighted match the byte frequencies of the -byte_list file\n");
+    fprintf(stderr, "  -engine random number generator: -engine random or -engine bulk\n");
     fprintf(stderr, "  -start_skip skip the first N random numbers: -start_skip number\n");
     fprintf(stderr, "  -skip skip N numbers on each call to random: -skip number\n");
     fprintf(stderr, "  -skip_random skip randomly at each call to random()\n");
@@ -65,28 +57,267 @@ sub_fail(char *argv0)
     fprintf(stderr, "  -filter_file file of skip N numbers: -filter_file filename\n");
     fprintf(stderr, "  -filter_skip bytes to skip in the filter file: -filter_skip number\n");
     fprintf(stderr, "  -filter_mask mask to be used for skip numbers: -filter_mask number\n");
+    fprintf(stderr, "  -checkpoint_file file of saved generator states: -checkpoint_file filename\n");
+    fprintf(stderr, "  -checkpoint_interval tokens between checkpoints: -checkpoint_interval number\n");
     fprintf(stderr, "\n");
     exit(1);
 }
 
-static int bytes[256];
-static int bytes_count;
-static int uniform_byte_counts[256];
-static int uniform_byte_count;
-// options
-static bool uniform = false;
-static time_t key = 0;
-static unsigned long start_skip = 0;
-static FILE *fp_byte_list = NULL;
-static unsigned long skip = 0;
-static bool skip_random = false;
-static unsigned char skip_random_mask = 0377;
-static FILE *fp_filter = NULL;
-static unsigned char filter_mask = 0377;
-static unsigned long filter_skip = 0;
-
-void ecorpus_tokens_init(char *argv0, char *stream_file)
+
+/*
+ * checkpoints - the generator state saved every checkpoint_interval tokens
+ *
+ *  the checkpoint file starts with a header describing the stream options
+ *  followed by one checkpoint record per interval.  The header holds a
+ *  hash of the byte values and weights, since byte lists of the same size
+ *  make different streams.  If the file exists it
+ *  is read and used for seeking; if it does not exist it is created and
+ *  filled in as the tokens are generated.
+ */
+#define CHECKPOINT_MAGIC "ECKPT03"
+
+struct checkpoint_header
+{
+    char magic[8];
+    unsigned long key;
+    unsigned long start_skip;
+    unsigned long skip;
+    unsigned long filter_skip;
+    unsigned long interval;
+    int bytes_count;
+    uint64_t bytes_hash;	// bytes[] and the weights table
+    unsigned char uniform;
+    unsigned char weighted;
+    unsigned char skip_random;
+    unsigned char skip_random_mask;
+    unsigned char filter_mask;
+    unsigned char bulk;
+};
+
+struct checkpoint
+{
+    unsigned long token;	// count of tokens generated before this state
+    long filter_offset;
+    int uniform_byte_count;
+    int uniform_byte_counts[256];
+    char random_state[128];
+    struct ebulk_mark bulk_tokens;
+    struct ebulk_mark bulk_skips;
+};
+
+#define ECORPUS_RING_PIECE 4096
+
+/*
+ * a corpus stream - all of the generator state is kept here so that a
+ *  process can open many streams and run them in separate threads
+ */
+struct ecorpus_stream
+{
+    int bytes[256];
+    int bytes_count;
+    int uniform_byte_counts[256];
+    int uniform_byte_count;
+    int uniform_block_size;
+    unsigned char weights_table[EWEIGHTS_BLOCK + 256];
+    unsigned int weights_total;
+    // options
+    bool uniform;
+    time_t key;
+    unsigned long start_skip;
+    FILE *fp_byte_list;
+    bool weighted;
+    bool bulk;
+    struct ebulk bulk_tokens;
+    struct ebulk bulk_skips;
+    unsigned long skip;
+    bool skip_random;
+    unsigned char skip_random_mask;
+    FILE *fp_filter;
+    unsigned char filter_mask;
+    unsigned long filter_skip;
+    char *checkpoint_file;
+    unsigned long checkpoint_interval;
+    // the private random() state
+#ifndef __STRICT_ANSI__
+    struct random_data random_data;
+#endif
+    int32_t random_state[32];
+    int32_t random_scratch[32];
+    // checkpoints
+    unsigned long token_count;
+    struct checkpoint *checkpoints;
+    unsigned long checkpoints_count;
+    FILE *fp_checkpoint;	// set when recording checkpoints
+    char *argv0;
+};
+
+/*
+ * the generator runs on a private random() state so that the state can
+ *  be saved in checkpoints and restored later - and so that streams do
+ *  not share it.  initstate_r() with 128 bytes gives the same sequence as
+ *  the default srandom() state.
+ */
+static long int prandom(struct ecorpus_stream *t)
+{
+#ifdef __STRICT_ANSI__
+    return rand();
+#else
+    int32_t result;
+
+    random_r(&t->random_data, &result);
+    return result;
+#endif
+}
+
+static void psrandom(struct ecorpus_stream *t, unsigned int key)
+{
+#ifdef __STRICT_ANSI__
+    srand(key);
+#else
+    initstate_r(1, (char *) t->random_scratch, sizeof(t->random_scratch),
+		&t->random_data);
+    initstate_r(key, (char *) t->random_state, sizeof(t->random_state),
+		&t->random_data);
+#endif
+}
+
+static uint64_t
+checkpoint_bytes_hash(struct ecorpus_stream *t)
+{
+    uint64_t lanes[4] = { t->weights_total, 1, 2, 3 };
+
+    efingerprint_add(lanes, (unsigned char *) t->bytes, sizeof(t->bytes));
+    efingerprint_add(lanes, t->weights_table, t->weights_total);
+
+    return efingerprint_finish(lanes);
+}
+
+static void
+checkpoint_header_fill(struct ecorpus_stream *t,
+		       struct checkpoint_header *header)
+{
+    memset(header, 0, sizeof(*header));
+    strcpy(header->magic, CHECKPOINT_MAGIC);
+    header->key = t->key;
+    header->start_skip = t->start_skip;
+    header->skip = t->skip;
+    header->filter_skip = t->filter_skip;
+    header->interval = t->checkpoint_interval;
+    header->bytes_count = t->bytes_count;
+    header->bytes_hash = checkpoint_bytes_hash(t);
+    header->uniform = t->uniform;
+    header->weighted = t->weighted;
+    header->skip_random = t->skip_random;
+    header->skip_random_mask = t->skip_random_mask;
+    header->filter_mask = t->filter_mask;
+    header->bulk = t->bulk;
+}
+
+/*
+ * read the checkpoints for seeking - or create the file for recording
+ */
+static void
+checkpoints_open(struct ecorpus_stream *t, char *argv0)
 {
+    struct checkpoint_header header;
+    struct checkpoint_header header_file;
+    FILE *fp;
+
+    checkpoint_header_fill(t, &header);
+
+    fp = fopen(t->checkpoint_file, "rb");
+    if (fp == NULL)
+    {
+	t->fp_checkpoint = fopen(t->checkpoint_file, "wb");
+	if (t->fp_checkpoint == NULL)
+	{
+	    fprintf(stderr, "%s: cannot create the checkpoint file: %s\n",
+		    argv0, t->checkpoint_file);
+	    sub_fail(argv0);
+	}
+	fwrite(&header, sizeof(header), 1, t->fp_checkpoint);
+	return;
+    }
+
+    if (fread(&header_file, sizeof(header_file), 1, fp) != 1 ||
+	memcmp(&header, &header_file, sizeof(header)) != 0)
+    {
+	fprintf(stderr, "%s: the checkpoint file does not match the stream options: %s\n",
+		argv0, t->checkpoint_file);
+	sub_fail(argv0);
+    }
+
+    while (true)
+    {
+	t->checkpoints = realloc(t->checkpoints,
+			      (t->checkpoints_count + 1) * sizeof(struct checkpoint));
+	if (t->checkpoints == NULL)
+	{
+	    fprintf(stderr, "%s: out of memory reading the checkpoint file: %s\n",
+		    argv0, t->checkpoint_file);
+	    exit(1);
+	}
+
+	if (fread(&t->checkpoints[t->checkpoints_count],
+		  sizeof(struct checkpoint), 1, fp) != 1)
+	    break;
+	t->checkpoints_count++;
+    }
+
+    fclose(fp);
+}
+
+/*
+ * save and restore the generator state
+ *
+ *  setstate_r() stores the position of the current random() state into
+ *  its buffer.  Restoring must switch to another buffer first or
+ *  setstate_r() would overwrite the restored position.
+ */
+static void
+checkpoint_save(struct ecorpus_stream *t, struct checkpoint *checkpoint)
+{
+    checkpoint->token = t->token_count;
+    checkpoint->filter_offset = (t->fp_filter != NULL) ? ftell(t->fp_filter) : 0;
+    checkpoint->uniform_byte_count = t->uniform_byte_count;
+    memcpy(checkpoint->uniform_byte_counts, t->uniform_byte_counts,
+	   sizeof(t->uniform_byte_counts));
+#ifndef __STRICT_ANSI__
+    setstate_r((char *) t->random_state, &t->random_data);
+#endif
+    memcpy(checkpoint->random_state, t->random_state, sizeof(t->random_state));
+    checkpoint->bulk_tokens = t->bulk_tokens.mark;
+    checkpoint->bulk_skips = t->bulk_skips.mark;
+}
+
+static void
+checkpoint_restore(struct ecorpus_stream *t, struct checkpoint *checkpoint)
+{
+    t->token_count = checkpoint->token;
+    if (t->fp_filter != NULL)
+	fseek(t->fp_filter, checkpoint->filter_offset, SEEK_SET);
+    t->uniform_byte_count = checkpoint->uniform_byte_count;
+    memcpy(t->uniform_byte_counts, checkpoint->uniform_byte_counts,
+	   sizeof(t->uniform_byte_counts));
+#ifndef __STRICT_ANSI__
+    setstate_r((char *) t->random_scratch, &t->random_data);
+    memcpy(t->random_state, checkpoint->random_state, sizeof(t->random_state));
+    setstate_r((char *) t->random_state, &t->random_data);
+#endif
+    if (t->bulk)
+    {
+	ebulk_restore(&t->bulk_tokens, &checkpoint->bulk_tokens);
+	ebulk_restore(&t->bulk_skips, &checkpoint->bulk_skips);
+    }
+}
+
+/*
+ * open a stream from its "stream:filename" description
+ */
+struct ecorpus_stream *
+ecorpus_tokens_open(char *argv0, char *stream_file)
+{
+    struct ecorpus_stream *t;
     FILE *fp_stream = NULL;
     char buf[1024];
 
@@ -96,6 +327,18 @@ void ecorpus_tokens_init(char *argv0, char *stream_file)
 
     char *ptr = strchr(stream_file, ':');
 
+    t = (struct ecorpus_stream *) calloc(1, sizeof(struct ecorpus_stream));
+    if (t == NULL)
+    {
+	fprintf(stderr, "%s: out of memory for the stream: %s\n",
+		argv0, stream_file);
+	exit(1);
+    }
+    t->argv0 = argv0;
+    t->skip_random_mask = 0377;
+    t->filter_mask = 0377;
+    t->checkpoint_interval = 1048576;
+
     if (ptr == NULL)
     {
 	fprintf(stderr, "%s: badly formed stream file: %s\n",
@@ -167,7 +410,7 @@ void ecorpus_tokens_init(char *argv0, char *stream_file)
 	 */
 	if (strcmp(argv1, "-uniform") == 0)
 	{
-	    uniform = true;
+	    t->uniform = true;
 	    continue;
 	}
 
@@ -187,7 +430,7 @@ void ecorpus_tokens_init(char *argv0, char *stream_file)
 		sub_fail(argv0);
 	    }
 
-	    key = scan_token;
+	    t->key = scan_token;
 	    continue;
 	}
 
@@ -207,7 +450,7 @@ void ecorpus_tokens_init(char *argv0, char *stream_file)
 		sub_fail(argv0);
 	    }
 
-	    start_skip = scan_token;
+	    t->start_skip = scan_token;
 	    continue;
 	}
 
@@ -219,8 +462,8 @@ void ecorpus_tokens_init(char *argv0, char *stream_file)
 		sub_fail(argv0);
 	    }
 
-	    fp_byte_list = fopen(argv2, "r");
-	    if (fp_byte_list == NULL)
+	    t->fp_byte_list = fopen(argv2, "r");
+	    if (t->fp_byte_list == NULL)
 	    {
 		fprintf(stderr, "%s: cannot open the byte_list: %s\n",
 			argv0, argv2);
@@ -229,6 +472,25 @@ void ecorpus_tokens_init(char *argv0, char *stream_file)
 	    continue;
 	}
 
+	if (strcmp(argv1, "-weighted") == 0)
+	{
+	    t->weighted = true;
+	    continue;
+	}
+
+	if (strcmp(argv1, "-engine") == 0)
+	{
+	    if (strcmp(argv2, "bulk") == 0)
+		t->bulk = true;
+	    else if (strcmp(argv2, "random") != 0)
+	    {
+		fprintf(stderr, "%s: -engine (%s) is not random or bulk\n",
+			argv0, argv2);
+		sub_fail(argv0);
+	    }
+	    continue;
+	}
+
 	if (strcmp(argv1, "-skip") == 0)
 	{
 	    if  (*argv2 == '\0')
@@ -245,13 +507,13 @@ void ecorpus_tokens_init(char *argv0, char *stream_file)
 		sub_fail(argv0);
 	    }
 
-	    skip = scan_token;
+	    t->skip = scan_token;
 	    continue;
 	}
 
 	if (strcmp(argv1, "-skip_random") == 0)
 	{
-	    skip_random = true;
+	    t->skip_random = true;
 	    continue;
 	}
 
@@ -283,7 +545,7 @@ void ecorpus_tokens_init(char *argv0, char *stream_file)
 		sub_fail(argv0);
 	    }
 
-	    skip_random_mask = octal_int;
+	    t->skip_random_mask = octal_int;
 	    continue;
 	}
 
@@ -295,8 +557,8 @@ void ecorpus_tokens_init(char *argv0, char *stream_file)
 		sub_fail(argv0);
 	    }
 
-	    fp_filter = fopen(argv2, "r");
-	    if (fp_filter == NULL)
+	    t->fp_filter = fopen(argv2, "r");
+	    if (t->fp_filter == NULL)
 	    {
 		fprintf(stderr, "%s: cannot open the filter file: %s\n",
 			argv0, argv2);
@@ -321,7 +583,7 @@ void ecorpus_tokens_init(char *argv0, char *stream_file)
 		sub_fail(argv0);
 	    }
 
-	    filter_skip = scan_token;
+	    t->filter_skip = scan_token;
 	    continue;
 	}
 
@@ -352,83 +614,144 @@ void ecorpus_tokens_init(char *argv0, char *stream_file)
 		sub_fail(argv0);
 	    }
 
-	    filter_mask = octal_int;
+	    t->filter_mask = octal_int;
+	    continue;
+	}
+
+	if (strcmp(argv1, "-checkpoint_file") == 0)
+	{
+	    if  (*argv2 == '\0')
+	    {
+		fprintf(stderr, "%s: no -checkpoint_file filename given\n", argv0);
+		sub_fail(argv0);
+	    }
+
+	    t->checkpoint_file = strdup(argv2);
+	    continue;
+	}
+
+	if (strcmp(argv1, "-checkpoint_interval") == 0)
+	{
+	    if  (*argv2 == '\0')
+	    {
+		fprintf(stderr, "%s: no -checkpoint_interval value given\n", argv0);
+		sub_fail(argv0);
+	    }
+
+	    rvalue = sscanf(argv2, "%lu", &scan_token);
+	    if (rvalue == 0 || rvalue == EOF || scan_token == 0 ||
+		scan_token > UINT_MAX)
+	    {
+		fprintf(stderr, "%s: -checkpoint_interval value (%s) is not an integer in the range of 1 to %u\n",
+			argv0, argv2, UINT_MAX);
+		sub_fail(argv0);
+	    }
+
+	    t->checkpoint_interval = scan_token;
 	    continue;
 	}
     }
 
-    if (uniform == true)
+    if (t->uniform == true)
 	fprintf(stdout, "uniform blocks enabled\n");
 
-    if (key != 0)
+    if (t->key != 0)
 	fprintf(stdout, "key provided\n");
 	    
-    if (fp_byte_list != NULL)
+    if (t->fp_byte_list != NULL)
 	fprintf(stdout, "byte_list provided\n");
 
-    if (start_skip != 0)
+    if (t->weighted == true)
+    {
+	if (t->fp_byte_list == NULL)
+	{
+	    fprintf(stderr, "%s: -weighted needs a -byte_list file\n", argv0);
+	    sub_fail(argv0);
+	}
+	fprintf(stdout, "weighted byte_list enabled\n");
+    }
+
+    if (t->bulk == true)
+	fprintf(stdout, "bulk engine enabled\n");
+
+    if (t->start_skip != 0)
 	fprintf(stdout, "start_skip provided\n");
 
-    if (skip != 0)
+    if (t->skip != 0)
 	fprintf(stdout, "skip provided\n");
 	    
-    if (skip_random == true)
+    if (t->skip_random == true)
 	fprintf(stdout, "skip_random enabled\n");
 
-    if(fp_filter != NULL)
+    if(t->fp_filter != NULL)
 	fprintf(stdout, "filter_file provided\n");
 
     /*
      * open the byte_list file - create the corpus file with specific bytes.
      *   this makes the encrypted files smaller
      */
-    if (fp_byte_list != NULL)
+    if (t->fp_byte_list != NULL)
     {
-	bytes_count = 0;
+	t->bytes_count = 0;
 	for (int i = 0; i < 256; i++)
-	    bytes[i] = 0;
+	    t->bytes[i] = 0;
 
 	while (true)
 	{
-	    c = fgetc(fp_byte_list) & 0377;
-	    if (feof(fp_byte_list))
+	    c = fgetc(t->fp_byte_list) & 0377;
+	    if (feof(t->fp_byte_list))
 		break;
 
-	    bytes[c]++;
+	    t->bytes[c]++;
 
 	    /*
-	     * optional speed up - remove if balancing byte proportions
+	     * optional speed up - the weighted list needs every count
 	     */
-	    if(bytes[c] == 1)
-		bytes_count++;
-	    if (bytes_count == 256)
+	    if(t->bytes[c] == 1)
+		t->bytes_count++;
+	    if (t->bytes_count == 256 && t->weighted == false)
 		break;
 	}
 
-	fclose(fp_byte_list);
+	fclose(t->fp_byte_list);
 
-	fprintf(stdout, "unique bytes count = %d\n", bytes_count);
+	fprintf(stdout, "unique bytes count = %d\n", t->bytes_count);
+
+	/*
+	 * bytes[] is the count of each byte value in a uniform block
+	 */
+	if (t->weighted)
+	    t->weights_total = eweights_build(t->bytes, t->weights_table);
+	else
+	{
+	    for (int i = 0; i < 256; i++)
+		t->bytes[i] = (t->bytes[i] != 0);
+	}
     }
     else
     {
 	for (int i = 0; i < 256; i++)
-	    bytes[i] = 1;
+	    t->bytes[i] = 1;
 
-	bytes_count = 256;
+	t->bytes_count = 256;
     }
 
+    t->uniform_block_size = 0;
+    for (int i = 0; i < 256; i++)
+	t->uniform_block_size += t->bytes[i];
+
     /*
      * advance the filter_file the filter_skip byte count
      */
-    if (fp_filter != NULL && filter_skip > 0)
+    if (t->fp_filter != NULL && t->filter_skip > 0)
     {
-	for (unsigned int i = filter_skip; i > 0; i--)
+	for (unsigned int i = t->filter_skip; i > 0; i--)
 	{
-	    c = fgetc(fp_filter);
-	    if (feof(fp_filter))
+	    c = fgetc(t->fp_filter);
+	    if (feof(t->fp_filter))
 	    {
-		fclose(fp_filter);
-		fp_filter = NULL;
+		fclose(t->fp_filter);
+		t->fp_filter = NULL;
 		fprintf(stderr, "%s: The filter_file is smaller than the filter_skip count\n", argv0);
 		sub_fail(argv0);
 		break;
@@ -439,83 +762,158 @@ void ecorpus_tokens_init(char *argv0, char *stream_file)
     /*
      * seed the random number generator
      */
-    if (key == 0)
+    if (t->key == 0)
+    {
+	if (t->checkpoint_file != NULL)
+	{
+	    fprintf(stderr, "%s: -checkpoint_file requires a -key\n", argv0);
+	    sub_fail(argv0);
+	}
+	t->key = ekey_derive(ekey_random(), 0);
+    }
+    psrandom(t, (unsigned int) t->key);
+
+    /*
+     * the bulk engine drops the bytes not in the byte list a buffer at a
+     *  time.  -skip_random draws from a second generator.
+     */
+    if (t->bulk)
     {
-	sleep(1);  // make back to back corpuses differ
-	key = time(NULL);
+	ebulk_init(&t->bulk_tokens, t->key,
+		   (t->bytes_count < 256 && t->weighted == false) ? t->bytes : NULL);
+	ebulk_init(&t->bulk_skips, t->key ^ 0x736b6970, NULL);
     }
-    psrandom((unsigned int) key);
+
+    if (t->checkpoint_file != NULL)
+	checkpoints_open(t, argv0);
 
     /*
      * clear the tabulation arrays
      */
     for (int i = 0; i < 256; i++)
-	uniform_byte_counts[i] = 0;
+	t->uniform_byte_counts[i] = 0;
 
-    uniform_byte_count = 0;
+    t->uniform_byte_count = 0;
 
     /*
      * generate - all of the stuff above is fluff
      */
-    if (skip_random)
-	start_skip += prandom() & skip_random_mask;
+    if (t->skip_random)
+	t->start_skip += (t->bulk ? ebulk_byte(&t->bulk_skips) : prandom(t)) &
+	    t->skip_random_mask;
 
-    for (unsigned int j = 0; j < start_skip; j++)
-	prandom();
+    if (t->bulk)
+	ebulk_skip(&t->bulk_tokens, t->start_skip);
+    else
+	for (unsigned int j = 0; j < t->start_skip; j++)
+	    prandom(t);
 
     fclose(fp_stream);
+    return t;
+}
+
+/*
+ * release a stream and the files it holds open
+ */
+void ecorpus_tokens_close(struct ecorpus_stream *t)
+{
+    if (t == NULL)
+	return;
+    if (t->fp_filter != NULL)
+	fclose(t->fp_filter);
+    if (t->fp_checkpoint != NULL)
+	fclose(t->fp_checkpoint);
+    free(t->checkpoints);
+    free(t->checkpoint_file);
+    free(t);
 }
 
 
-unsigned char ecorpus_next_token ()
+unsigned char ecorpus_next_token(struct ecorpus_stream *t)
 {
     unsigned char token;
 
+    /*
+     * record a checkpoint at the start of each interval
+     */
+    if (t->fp_checkpoint != NULL && t->token_count % t->checkpoint_interval == 0)
+    {
+	struct checkpoint checkpoint;
+
+	checkpoint_save(t, &checkpoint);
+	fwrite(&checkpoint, sizeof(checkpoint), 1, t->fp_checkpoint);
+    }
+    t->token_count++;
+
     while (true)
     {
 	unsigned long skipr = 0;
 	unsigned long skipf = 0;
 
-	if (fp_filter != NULL)
+	if (t->fp_filter != NULL)
 	{
-	    fgetc(fp_filter);
-	    if (feof(fp_filter))  // loop back around
+	    fgetc(t->fp_filter);
+	    if (feof(t->fp_filter))  // loop back around
 	    {
-		rewind(fp_filter);
-		for (unsigned int j = filter_skip; j > 0; j--)
-		    fgetc(fp_filter);
+		rewind(t->fp_filter);
+		for (unsigned int j = t->filter_skip; j > 0; j--)
+		    fgetc(t->fp_filter);
 	    }
 
-	    skipf = fgetc(fp_filter) & filter_mask;
+	    skipf = fgetc(t->fp_filter) & t->filter_mask;
 	}
 
 
-	if (skip_random)
-	    skipr = prandom() & skip_random_mask;
+	if (t->skip_random)
+	    skipr = (t->bulk ? ebulk_byte(&t->bulk_skips) : prandom(t)) &
+		t->skip_random_mask;
 
-	skipr = skipr + skipf + skip;
+	skipr = skipr + skipf + t->skip;
 
-	for (unsigned int j = 0; j < skipr; j++)
-	    token = prandom();
+	if (t->bulk)
+	    ebulk_skip(&t->bulk_tokens, skipr);
+	else
+	    for (unsigned int j = 0; j < skipr; j++)
+		token = prandom(t);
+	ESTATS_ADD(skip_calls, skipr);
 
-	token = prandom() & 0377;
+	if (t->bulk && t->weighted)
+	{
+	    unsigned int r = ebulk_byte(&t->bulk_tokens);
 
-	if (bytes[token] == 0)
+	    r = (r << 8) | ebulk_byte(&t->bulk_tokens);
+	    token = t->weights_table[r % t->weights_total];
+	}
+	else if (t->bulk)
+	    token = ebulk_byte(&t->bulk_tokens);
+	else if (t->weighted)
+	    token = t->weights_table[prandom(t) % t->weights_total];
+	else
+	    token = prandom(t) & 0377;
+
+	if (t->bytes[token] == 0)
+	{
+	    ESTATS_ADD(byte_list_retries, 1);
 	    continue;
+	}
 
-	if(uniform && uniform_byte_counts[token] != 0)
+	if(t->uniform && t->uniform_byte_counts[token] >= t->bytes[token])
+	{
+	    ESTATS_ADD(uniform_retries, 1);
 	    continue;
+	}
+	ESTATS_ADD(tokens_generated, 1);
 
-	if(uniform)
+	if(t->uniform)
 	{
-	    uniform_byte_counts[token] = 1;
-	    uniform_byte_count++;
+	    t->uniform_byte_counts[token]++;
+	    t->uniform_byte_count++;
 
-	    if (uniform_byte_count == bytes_count)
+	    if (t->uniform_byte_count == t->uniform_block_size)
 	    {
-		uniform_byte_count = 0;
+		t->uniform_byte_count = 0;
 		for (int j = 0; j < 256; j++)
-		    uniform_byte_counts[j] = 0;
+		    t->uniform_byte_counts[j] = 0;
 	    }
 	}
 
@@ -524,3 +922,217 @@ unsigned char ecorpus_next_token ()
     // never here
     return token;
 }
+
+
+/*
+ * position the stream so that count tokens have been generated
+ *
+ *  the nearest checkpoint at or before count is restored when it is ahead
+ *  of the current position - or when seeking backwards.  The remaining
+ *  tokens are generated.
+ */
+void ecorpus_tokens_seek(struct ecorpus_stream *t, unsigned long count)
+{
+    struct checkpoint *nearest = NULL;
+
+    for (unsigned long i = 0; i < t->checkpoints_count; i++)
+    {
+	if (t->checkpoints[i].token > count)
+	    break;
+	nearest = &t->checkpoints[i];
+    }
+
+    if (nearest != NULL && (nearest->token > t->token_count || count < t->token_count))
+	checkpoint_restore(t, nearest);
+
+    if (count < t->token_count)
+    {
+	fprintf(stderr, "%s: cannot seek the stream back to token %lu without a checkpoint\n",
+		t->argv0, count);
+	exit(1);
+    }
+
+    while (t->token_count < count)
+	ecorpus_next_token(t);
+}
+
+
+/*
+ * a ring of tokens filled ahead of the reader by a producer thread
+ *
+ *  one thread writes and one thread reads so the ring needs no lock:
+ *  the producer owns head and the reader owns tail.  The producer
+ *  publishes tokens with a release store of head, the reader frees them
+ *  with a release store of tail.  A side that finds the ring full or
+ *  empty sleeps in ewait_until() until the other side wakes it.
+ */
+struct ecorpus_ring
+{
+    struct ecorpus_stream *stream;
+    unsigned char *buffer;
+    size_t size;		// a power of two
+    unsigned long long head;	// tokens produced
+    unsigned long long tail;	// tokens consumed
+    bool stop;
+    pthread_t thread;
+    struct ewait space;		// the producer sleeps here when it is full
+    struct ewait tokens;	// the reader sleeps here when it is empty
+};
+
+static bool
+ecorpus_ring_has_space(void *arg)
+{
+    struct ecorpus_ring *ring = (struct ecorpus_ring *) arg;
+
+    return __atomic_load_n(&ring->stop, __ATOMIC_RELAXED) ||
+	ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) < ring->size;
+}
+
+static bool
+ecorpus_ring_has_tokens(void *arg)
+{
+    struct ecorpus_ring *ring = (struct ecorpus_ring *) arg;
+
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != ring->tail;
+}
+
+static void *
+ecorpus_ring_producer(void *arg)
+{
+    struct ecorpus_ring *ring = (struct ecorpus_ring *) arg;
+    unsigned long long head = ring->head;
+
+    while (__atomic_load_n(&ring->stop, __ATOMIC_RELAXED) == false)
+    {
+	unsigned long long tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	size_t offset = head & (ring->size - 1);
+	size_t length = ring->size - (head - tail);
+
+	if (length == 0)
+	{
+	    ewait_until(&ring->space, ecorpus_ring_has_space, ring);
+	    continue;
+	}
+
+	// fill a small piece at a time so the reader is not kept waiting
+	if (length > ring->size - offset)
+	    length = ring->size - offset;
+	if (length > ECORPUS_RING_PIECE)
+	    length = ECORPUS_RING_PIECE;
+
+	for (size_t i = 0; i < length; i++)
+	    ring->buffer[offset + i] = ecorpus_next_token(ring->stream);
+
+	head += length;
+	__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+	ewait_wake(&ring->tokens);
+    }
+
+    return NULL;
+}
+
+/*
+ * start a producer thread on a stream - the stream is positioned first
+ *  and belongs to the ring until ecorpus_ring_close()
+ */
+struct ecorpus_ring *
+ecorpus_ring_open(struct ecorpus_stream *stream, size_t size)
+{
+    struct ecorpus_ring *ring;
+    size_t power = ECORPUS_RING_PIECE;
+
+    while (power < size)
+	power *= 2;
+
+    ring = (struct ecorpus_ring *) calloc(1, sizeof(struct ecorpus_ring));
+    if (ring != NULL)
+	ring->buffer = (unsigned char *) malloc(power);
+    if (ring == NULL || ring->buffer == NULL)
+    {
+	fprintf(stderr, "%s: out of memory for the stream ring\n", stream->argv0);
+	exit(1);
+    }
+    ring->stream = stream;
+    ring->size = power;
+    ewait_init(&ring->space);
+    ewait_init(&ring->tokens);
+
+    if (pthread_create(&ring->thread, NULL, ecorpus_ring_producer, ring) != 0)
+    {
+	fprintf(stderr, "%s: cannot create the stream producer thread\n",
+		stream->argv0);
+	exit(1);
+    }
+
+    return ring;
+}
+
+/*
+ * the next tokens as one piece of memory - *length is at least one
+ *
+ *  the window ends at the end of the ring or at the last token produced.
+ */
+const unsigned char *
+ecorpus_ring_window(struct ecorpus_ring *ring, size_t *length)
+{
+    unsigned long long tail = ring->tail;
+    unsigned long long head;
+    size_t offset = tail & (ring->size - 1);
+
+    ewait_until(&ring->tokens, ecorpus_ring_has_tokens, ring);
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    *length = head - tail;
+    if (*length > ring->size - offset)
+	*length = ring->size - offset;
+
+    return ring->buffer + offset;
+}
+
+/*
+ * release the first length tokens of the window to the producer
+ */
+void ecorpus_ring_consume(struct ecorpus_ring *ring, size_t length)
+{
+    __atomic_store_n(&ring->tail, ring->tail + length, __ATOMIC_RELEASE);
+    ewait_wake(&ring->space);
+}
+
+/*
+ * pass over distance - 1 tokens and return the next one
+ */
+unsigned char ecorpus_ring_skip(struct ecorpus_ring *ring, unsigned long distance)
+{
+    const unsigned char *window;
+    size_t length;
+
+    while (true)
+    {
+	window = ecorpus_ring_window(ring, &length);
+	if (distance <= length)
+	{
+	    unsigned char token = window[distance - 1];
+
+	    ecorpus_ring_consume(ring, distance);
+	    return token;
+	}
+	ecorpus_ring_consume(ring, length);
+	distance -= length;
+    }
+}
+
+/*
+ * stop the producer - the stream is left open for the caller
+ */
+void ecorpus_ring_close(struct ecorpus_ring *ring)
+{
+    if (ring == NULL)
+	return;
+    __atomic_store_n(&ring->stop, true, __ATOMIC_RELAXED);
+    ewait_wake(&ring->space);
+    pthread_join(ring->thread, NULL);
+    ewait_destroy(&ring->space);
+    ewait_destroy(&ring->tokens);
+    free(ring->buffer);
+    free(ring);
+}
@@ -0,0 +1,55 @@
+/*
+ * ecorpus_tokens.h: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  stream corpora: corpus tokens generated on the fly
+ *
+ *  A stream is described by a "stream:filename" argument naming a file of
+ *  ecorpus options.  Each open stream carries its own generator state so
+ *  several streams can be used at once in one process.
+ *
+ *  A ring runs a stream on a producer thread ahead of its reader.  The
+ *  reader sees the tokens as windows of memory it can search directly.
+ */
+#ifndef ECORPUS_TOKENS_H
+#define ECORPUS_TOKENS_H
+
+#include <stddef.h>
+
+struct ecorpus_stream;
+
+extern struct ecorpus_stream *ecorpus_tokens_open(char *argv0, char *stream_file);
+extern unsigned char ecorpus_next_token(struct ecorpus_stream *stream);
+extern void ecorpus_tokens_seek(struct ecorpus_stream *stream, unsigned long count);
+extern void ecorpus_tokens_close(struct ecorpus_stream *stream);
+
+#define ECORPUS_RING_SIZE (1024 * 1024)
+
+struct ecorpus_ring;
+
+extern struct ecorpus_ring *ecorpus_ring_open(struct ecorpus_stream *stream, size_t size);
+extern const unsigned char *ecorpus_ring_window(struct ecorpus_ring *ring, size_t *length);
+extern void ecorpus_ring_consume(struct ecorpus_ring *ring, size_t length);
+extern unsigned char ecorpus_ring_skip(struct ecorpus_ring *ring, unsigned long distance);
+extern void ecorpus_ring_close(struct ecorpus_ring *ring);
+
+#endif
@@ -0,0 +1,176 @@
+/*
+ * ecpu.c: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  the processor specific kernels - see ecpu.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "ecpu.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ECPU_X86 1
+#endif
+
+const char *ecpu_names[ECPU_LEVELS] = { "scalar", "sse2", "avx2", "avx512" };
+enum ecpu_level ecpu_level = ECPU_SCALAR;
+
+static const unsigned char *
+find_scalar(const unsigned char *data, size_t length, unsigned char c)
+{
+    for (size_t i = 0; i < length; i++)
+	if (data[i] == c)
+	    return data + i;
+
+    return NULL;
+}
+
+#ifdef ECPU_X86
+__attribute__((target("sse2"))) static const unsigned char *
+find_sse2(const unsigned char *data, size_t length, unsigned char c)
+{
+    __m128i needle = _mm_set1_epi8(c);
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16)
+    {
+	__m128i v = _mm_loadu_si128((const __m128i *) (data + i));
+	unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+
+	if (mask != 0)
+	    return data + i + __builtin_ctz(mask);
+    }
+
+    return find_scalar(data + i, length - i, c);
+}
+
+/*
+ * the wide kernels clear the upper register halves before they return -
+ *  gcc adds the vzeroupper itself only from -O2, and the SSE code of the
+ *  callers runs slowly while the halves are dirty
+ */
+__attribute__((target("avx2"))) static const unsigned char *
+find_avx2(const unsigned char *data, size_t length, unsigned char c)
+{
+    __m256i needle = _mm256_set1_epi8(c);
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32)
+    {
+	__m256i v = _mm256_loadu_si256((const __m256i *) (data + i));
+	unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+
+	if (mask != 0)
+	{
+	    _mm256_zeroupper();
+	    return data + i + __builtin_ctz(mask);
+	}
+    }
+
+    _mm256_zeroupper();
+    return find_sse2(data + i, length - i, c);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static const unsigned char *
+find_avx512(const unsigned char *data, size_t length, unsigned char c)
+{
+    __m512i needle = _mm512_set1_epi8(c);
+    const unsigned char *found = NULL;
+    size_t i = 0;
+    __mmask64 mask = 0;
+
+    for (; i + 64 <= length; i += 64)
+    {
+	mask = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(data + i), needle);
+	if (mask != 0)
+	    break;
+    }
+
+    // the last bytes with a masked load - it does not fault past the end
+    if (mask == 0 && i < length)
+    {
+	__mmask64 tail = (1ULL << (length - i)) - 1;
+
+	mask = _mm512_mask_cmpeq_epi8_mask(tail,
+					   _mm512_maskz_loadu_epi8(tail, data + i),
+					   needle);
+    }
+    if (mask != 0)
+	found = data + i + __builtin_ctzll(mask);
+
+    _mm256_zeroupper();
+    return found;
+}
+#endif
+
+const unsigned char *(*ecpu_find)(const unsigned char *data, size_t length,
+				  unsigned char c) = find_scalar;
+
+/*
+ * pick the kernels before main() runs
+ */
+__attribute__((constructor)) static void
+ecpu_init(void)
+{
+    enum ecpu_level limit = ECPU_AVX512;
+    char *env = getenv("EMAP_CPU");
+
+    if (env != NULL)
+    {
+	for (int i = 0; i < ECPU_LEVELS; i++)
+	    if (strcmp(env, ecpu_names[i]) == 0)
+		limit = i;
+    }
+
+#ifdef ECPU_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+	ecpu_level = ECPU_SSE2;
+    if (__builtin_cpu_supports("avx2"))
+	ecpu_level = ECPU_AVX2;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+	ecpu_level = ECPU_AVX512;
+#endif
+    if (ecpu_level > limit)
+	ecpu_level = limit;
+
+    switch (ecpu_level)
+    {
+#ifdef ECPU_X86
+    case ECPU_AVX512:
+	ecpu_find = find_avx512;
+	break;
+    case ECPU_AVX2:
+	ecpu_find = find_avx2;
+	break;
+    case ECPU_SSE2:
+	ecpu_find = find_sse2;
+	break;
+#endif
+    default:
+	ecpu_find = find_scalar;
+	break;
+    }
+}
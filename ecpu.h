@@ -0,0 +1,55 @@
+/*
+ * ecpu.h: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  kernels picked for the processor when the program starts
+ *
+ *  the programs are built for the plain x86-64 instruction set so that
+ *  one binary runs on every machine.  The kernels here are also built
+ *  for SSE2, AVX2 and AVX-512, and the widest one the processor has is
+ *  picked at start up.  EMAP_CPU=scalar, sse2, avx2 or avx512 in the
+ *  environment sets a lower limit for testing and timing.
+ */
+#ifndef ECPU_H
+#define ECPU_H
+
+#include <stddef.h>
+
+enum ecpu_level
+{
+    ECPU_SCALAR,
+    ECPU_SSE2,
+    ECPU_AVX2,
+    ECPU_AVX512,
+    ECPU_LEVELS
+};
+
+extern enum ecpu_level ecpu_level;
+extern const char *ecpu_names[ECPU_LEVELS];
+
+/*
+ * the first c in the length bytes at data - or NULL
+ */
+extern const unsigned char *(*ecpu_find)(const unsigned char *data,
+					 size_t length, unsigned char c);
+
+#endif
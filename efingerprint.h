@@ -0,0 +1,172 @@
+/*
+ * efingerprint.h: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  a ciphertext header with a fingerprint of the corpus and -start
+ *
+ *  emap -fingerprint starts the ciphertext with a 16 byte header: zero,
+ *  zero, "EMAPF", a codec byte and a 64 bit check value.  The codec is
+ *  '1' for plaintext and 'Z' for plaintext compressed with emap -compress
+ *  - see ecompress.h.  A ciphertext without a header can
+ *  never start with zero zero - a wrap of the first byte searches the
+ *  same corpus bytes again and fails - so eunmap recognizes the header
+ *  without an option.
+ *
+ *  the check is a hash of the corpus fingerprint and the -start value so
+ *  eunmap can refuse a wrong corpus or start before it decodes anything.
+ *  The fingerprint of a corpus file hashes the size and up to
+ *  EFINGERPRINT_BLOCKS blocks spread over the file: all of a small file
+ *  and a few megabytes of a huge pad, which costs milliseconds rather
+ *  than a pass over gigabytes.  The fingerprint of a stream: corpus
+ *  hashes its options file.
+ */
+#ifndef EFINGERPRINT_H
+#define EFINGERPRINT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define EFINGERPRINT_MAGIC "\0\0EMAPF"
+#define EFINGERPRINT_MAGIC_SIZE 7
+#define EFINGERPRINT_PLAIN '1'
+#define EFINGERPRINT_GZIP 'Z'
+#define EFINGERPRINT_SIZE 16
+#define EFINGERPRINT_BLOCKS 1024
+#define EFINGERPRINT_BLOCK 4096
+
+#define EFINGERPRINT_PRIME 0x9e3779b97f4a7c15ULL
+
+/*
+ * hash length bytes in four independent lanes of 64 bit words - the
+ *  lanes do not wait on each other so the multiplies overlap
+ */
+static inline void
+efingerprint_add(uint64_t lanes[4], const unsigned char *bytes, uint64_t length)
+{
+    uint64_t word;
+    uint64_t i = 0;
+
+    for (; i + 32 <= length; i += 32)
+	for (int lane = 0; lane < 4; lane++)
+	{
+	    memcpy(&word, bytes + i + lane * 8, 8);
+	    lanes[lane] = (lanes[lane] ^ word) * EFINGERPRINT_PRIME;
+	    lanes[lane] ^= lanes[lane] >> 29;
+	}
+
+    for (; i < length; i++)
+	lanes[0] = (lanes[0] ^ bytes[i]) * EFINGERPRINT_PRIME;
+}
+
+static inline uint64_t
+efingerprint_finish(uint64_t lanes[4])
+{
+    uint64_t hash = 0;
+
+    for (int lane = 0; lane < 4; lane++)
+    {
+	hash = (hash ^ lanes[lane]) * EFINGERPRINT_PRIME;
+	hash ^= hash >> 32;
+    }
+
+    return hash;
+}
+
+static inline uint64_t
+efingerprint_corpus(const unsigned char *corpus, uint64_t size_corpus)
+{
+    uint64_t lanes[4] = { size_corpus, 1, 2, 3 };
+    uint64_t blocks = (size_corpus + EFINGERPRINT_BLOCK - 1) / EFINGERPRINT_BLOCK;
+    uint64_t step = blocks <= EFINGERPRINT_BLOCKS ? 1 : blocks / EFINGERPRINT_BLOCKS;
+
+    for (uint64_t block = 0; block < blocks; block += step)
+    {
+	uint64_t offset = block * EFINGERPRINT_BLOCK;
+	uint64_t length = size_corpus - offset < EFINGERPRINT_BLOCK ?
+	    size_corpus - offset : EFINGERPRINT_BLOCK;
+
+	efingerprint_add(lanes, corpus + offset, length);
+    }
+
+    return efingerprint_finish(lanes);
+}
+
+/*
+ * a stream: corpus is known by its options file - false if it cannot be
+ *  read
+ */
+static inline bool
+efingerprint_stream(const char *stream, uint64_t *fingerprint)
+{
+    uint64_t lanes[4] = { 0, 1, 2, 3 };
+    unsigned char buffer[4096];
+    size_t length;
+    FILE *fp;
+
+    fp = fopen(stream + strlen("stream:"), "r");
+    if (fp == NULL)
+	return false;
+    while ((length = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+	efingerprint_add(lanes, buffer, length);
+    fclose(fp);
+
+    *fingerprint = efingerprint_finish(lanes);
+    return true;
+}
+
+static inline uint64_t
+efingerprint_check(uint64_t fingerprint, uint64_t start)
+{
+    uint64_t lanes[4] = { fingerprint, start, 2, 3 };
+
+    return efingerprint_finish(lanes);
+}
+
+static inline void
+efingerprint_put(unsigned char *header, unsigned char codec, uint64_t check)
+{
+    memcpy(header, EFINGERPRINT_MAGIC, EFINGERPRINT_MAGIC_SIZE);
+    header[EFINGERPRINT_MAGIC_SIZE] = codec;
+    for (int i = 0; i < 8; i++)
+	header[EFINGERPRINT_MAGIC_SIZE + 1 + i] = check >> (8 * i);
+}
+
+/*
+ * the codec and check value of a header - false if it is not a header
+ */
+static inline bool
+efingerprint_get(const unsigned char *header, unsigned char *codec,
+		 uint64_t *check)
+{
+    if (memcmp(header, EFINGERPRINT_MAGIC, EFINGERPRINT_MAGIC_SIZE) != 0)
+	return false;
+
+    *codec = header[EFINGERPRINT_MAGIC_SIZE];
+    *check = 0;
+    for (int i = 0; i < 8; i++)
+	*check |= (uint64_t) header[EFINGERPRINT_MAGIC_SIZE + 1 + i] << (8 * i);
+    return true;
+}
+
+#endif
@@ -0,0 +1,377 @@
+/*
+ * eindex.c: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  the Elias-Fano position index - see eindex.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "eindex.h"
+
+static inline uint64_t
+bits_get(const uint64_t *words, uint64_t bit, uint64_t bits)
+{
+    uint64_t value;
+    uint64_t offset = bit % 64;
+
+    if (bits == 0)
+	return 0;
+    value = words[bit / 64] >> offset;
+    if (offset + bits > 64)
+	value |= words[bit / 64 + 1] << (64 - offset);
+
+    return value & (~0ULL >> (64 - bits));
+}
+
+static inline void
+bits_put(uint64_t *words, uint64_t bit, uint64_t bits, uint64_t value)
+{
+    uint64_t offset = bit % 64;
+
+    if (bits == 0)
+	return;
+    words[bit / 64] |= value << offset;
+    if (offset + bits > 64)
+	words[bit / 64 + 1] |= value >> (64 - offset);
+}
+
+/*
+ * the bit position of zero number k of a list's high bits
+ */
+static uint64_t
+select_zero(const struct eindex *index, const struct eindex_list *list,
+	    uint64_t k)
+{
+    const uint64_t *high = index->words + list->high;
+    uint64_t bit = index->words[list->samples + k / EINDEX_SAMPLE];
+    uint64_t word;
+
+    k %= EINDEX_SAMPLE;
+
+    // the sampled zero is zero number 0 from here
+    word = ~high[bit / 64] & (~0ULL << (bit % 64));
+    bit -= bit % 64;
+    while (k >= (uint64_t) __builtin_popcountll(word))
+    {
+	k -= __builtin_popcountll(word);
+	bit += 64;
+	word = ~high[bit / 64];
+    }
+
+    while (k-- > 0)
+	word &= word - 1;
+
+    return bit + __builtin_ctzll(word);
+}
+
+/*
+ * the first position after position holding c - or -1 when there is none
+ *
+ *  the zero ending bucket h - 1 is found with the select samples.  The
+ *  positions from there on are read until one is past position.
+ */
+int64_t
+eindex_next(const struct eindex *index, unsigned char c, int64_t position)
+{
+    const struct eindex_list *list = &index->header->lists[c];
+    const uint64_t *high = index->words + list->high;
+    const uint64_t *low = index->words + list->low;
+    uint64_t target = position + 1;
+    uint64_t bucket = target >> list->low_bits;
+    uint64_t bit;
+    uint64_t i;		// the list index of the position at bit
+    uint64_t word;
+
+    if (list->count == 0 || target >= index->header->size_corpus)
+	return -1;
+
+    bit = bucket == 0 ? 0 : select_zero(index, list, bucket - 1) + 1;
+    i = bit - bucket;
+
+    word = high[bit / 64] & (~0ULL << (bit % 64));
+    bit -= bit % 64;
+    while (i < list->count)
+    {
+	while (word == 0)
+	{
+	    bit += 64;
+	    word = high[bit / 64];
+	}
+
+	uint64_t one = bit + __builtin_ctzll(word);
+	uint64_t value = ((one - i) << list->low_bits) |
+	    bits_get(low, i * list->low_bits, list->low_bits);
+
+	if (value >= target)
+	    return value;
+	word &= word - 1;
+	i++;
+    }
+
+    return -1;
+}
+
+/*
+ * an FNV-1a hash of EINDEX_FINGERPRINT bytes spread over the corpus - an
+ *  index saved for another corpus of the same size is not used
+ */
+static uint64_t
+fingerprint(const unsigned char *corpus, uint64_t size_corpus)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    uint64_t stride = size_corpus / EINDEX_FINGERPRINT + 1;
+
+    for (uint64_t p = 0; p < size_corpus; p += stride)
+    {
+	hash ^= corpus[p];
+	hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/*
+ * build the index with one pass to count the byte values and one pass
+ *  to place the positions
+ */
+struct eindex *
+eindex_build(const unsigned char *corpus, uint64_t size_corpus)
+{
+    struct eindex *index;
+    struct eindex_header *header;
+    uint64_t counts[256] = { 0 };
+    uint64_t next[256] = { 0 };
+    uint64_t words = 0;
+    uint64_t *w;
+
+    for (uint64_t p = 0; p < size_corpus; p++)
+	counts[corpus[p]]++;
+
+    index = (struct eindex *) calloc(1, sizeof(struct eindex));
+    if (index == NULL)
+	return NULL;
+
+    /*
+     * lay out the lists - each array gets a spare word so that
+     *  bits_get() and the scans may read one word past the end
+     */
+    struct eindex_list lists[256];
+
+    for (int v = 0; v < 256; v++)
+    {
+	struct eindex_list *list = &lists[v];
+	uint64_t buckets;
+	uint64_t zeros;
+
+	list->count = counts[v];
+	list->low_bits = 0;
+	while (list->count != 0 &&
+	       (size_corpus >> (list->low_bits + 1)) >= list->count)
+	    list->low_bits++;
+
+	buckets = list->count == 0 ? 0 :
+	    ((size_corpus - 1) >> list->low_bits) + 1;
+	zeros = buckets;
+	list->high_bits = list->count + buckets;
+
+	list->low = words;
+	words += (list->count * list->low_bits + 63) / 64 + 1;
+	list->high = words;
+	words += (list->high_bits + 63) / 64 + 1;
+	list->samples = words;
+	words += (zeros + EINDEX_SAMPLE - 1) / EINDEX_SAMPLE + 1;
+    }
+
+    index->size = sizeof(struct eindex_header) + words * sizeof(uint64_t);
+    header = (struct eindex_header *) calloc(1, index->size);
+    if (header == NULL)
+    {
+	free(index);
+	return NULL;
+    }
+    memcpy(header->magic, EINDEX_MAGIC, sizeof(header->magic));
+    header->size_corpus = size_corpus;
+    header->fingerprint = fingerprint(corpus, size_corpus);
+    header->words = words;
+    memcpy(header->lists, lists, sizeof(lists));
+    index->header = header;
+    index->words = (const uint64_t *) (header + 1);
+    w = (uint64_t *) (header + 1);
+
+    for (uint64_t p = 0; p < size_corpus; p++)
+    {
+	struct eindex_list *list = &header->lists[corpus[p]];
+	uint64_t i = next[corpus[p]]++;
+
+	if (list->low_bits != 0)
+	    bits_put(w + list->low, i * list->low_bits, list->low_bits,
+		     p & (~0ULL >> (64 - list->low_bits)));
+	w[list->high + ((p >> list->low_bits) + i) / 64] |=
+	    1ULL << (((p >> list->low_bits) + i) % 64);
+    }
+
+    /*
+     * sample every EINDEX_SAMPLE'th zero of the high bits
+     */
+    for (int v = 0; v < 256; v++)
+    {
+	struct eindex_list *list = &header->lists[v];
+	uint64_t *high = w + list->high;
+	uint64_t zeros = 0;
+
+	for (uint64_t word = 0; word * 64 < list->high_bits; word++)
+	{
+	    uint64_t bits = ~high[word];
+	    uint64_t n;
+	    uint64_t sample;
+
+	    if ((word + 1) * 64 > list->high_bits)
+		bits &= ~0ULL >> ((word + 1) * 64 - list->high_bits);
+	    n = __builtin_popcountll(bits);
+
+	    // the samples among zero numbers zeros to zeros + n - 1
+	    sample = (zeros + EINDEX_SAMPLE - 1) / EINDEX_SAMPLE * EINDEX_SAMPLE;
+	    for (; sample < zeros + n; sample += EINDEX_SAMPLE)
+	    {
+		uint64_t b = bits;
+
+		for (uint64_t k = sample - zeros; k > 0; k--)
+		    b &= b - 1;
+		w[list->samples + sample / EINDEX_SAMPLE] =
+		    word * 64 + __builtin_ctzll(b);
+	    }
+	    zeros += n;
+	}
+    }
+
+    return index;
+}
+
+/*
+ * map an index written by eindex_write() - NULL if there is none or it
+ *  is not for this corpus
+ */
+struct eindex *
+eindex_open(const char *filename, const unsigned char *corpus,
+	    uint64_t size_corpus)
+{
+    struct eindex *index;
+    struct eindex_header *header;
+    struct stat s;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd == -1)
+	return NULL;
+    if (fstat(fd, &s) == -1 || s.st_size < sizeof(struct eindex_header))
+    {
+	close(fd);
+	return NULL;
+    }
+
+    header = (struct eindex_header *) mmap(NULL, s.st_size, PROT_READ,
+					   MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED)
+	return NULL;
+
+    if (memcmp(header->magic, EINDEX_MAGIC, sizeof(header->magic)) != 0 ||
+	header->size_corpus != size_corpus ||
+	header->fingerprint != fingerprint(corpus, size_corpus) ||
+	sizeof(struct eindex_header) + header->words * sizeof(uint64_t) !=
+	s.st_size)
+    {
+	munmap(header, s.st_size);
+	return NULL;
+    }
+
+    index = (struct eindex *) calloc(1, sizeof(struct eindex));
+    if (index == NULL)
+    {
+	munmap(header, s.st_size);
+	return NULL;
+    }
+    index->header = header;
+    index->words = (const uint64_t *) (header + 1);
+    index->size = s.st_size;
+    index->mapped = true;
+
+    return index;
+}
+
+/*
+ * write the index beside the file and rename it into place - another emap
+ *  may have the old index mapped
+ */
+bool
+eindex_write(const struct eindex *index, const char *filename)
+{
+    char temporary[4096];
+    FILE *fp;
+    bool written;
+
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp", filename) >=
+	sizeof(temporary))
+	return false;
+
+    fp = fopen(temporary, "w");
+    if (fp == NULL)
+	return false;
+    written = fwrite(index->header, 1, index->size, fp) == index->size;
+    if (fclose(fp) != 0)
+	written = false;
+
+    if (written && rename(temporary, filename) != 0)
+	written = false;
+    if (written == false)
+	unlink(temporary);
+
+    return written;
+}
+
+void
+eindex_close(struct eindex *index)
+{
+    if (index == NULL)
+	return;
+    if (index->mapped)
+	munmap(index->header, index->size);
+    else
+	free(index->header);
+    free(index);
+}
+
+void
+eindex_report(FILE *fp, char *argv0, const struct eindex *index)
+{
+    uint64_t size_corpus = index->header->size_corpus;
+
+    fprintf(fp, "%s: index %llu bytes for %llu corpus bytes - %.2f bits per corpus byte\n",
+	    argv0, (unsigned long long) index->size,
+	    (unsigned long long) size_corpus,
+	    size_corpus == 0 ? 0.0 : index->size * 8.0 / size_corpus);
+}
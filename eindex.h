@@ -0,0 +1,91 @@
+/*
+ * eindex.h: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  a compressed index of the positions of each byte value in a corpus
+ *
+ *  emap spends its time scanning the corpus for the next byte it needs.
+ *  The index answers "the next c after position p" directly.  The
+ *  positions of each byte value are kept as an Elias-Fano list: the low
+ *  bits of each position are packed into an array and the high bits are
+ *  written in unary into a bit vector.  A list of n positions in a corpus
+ *  of u bytes takes about n * (2 + log2(u / n)) bits, so the whole index
+ *  is at most about 10 bits per corpus byte - less for natural files.
+ *
+ *  the index is one block of memory with offsets rather than pointers so
+ *  it can be written to a file and mapped back in.
+ */
+#ifndef EINDEX_H
+#define EINDEX_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EINDEX_MAGIC "EINDEX01"
+#define EINDEX_FINGERPRINT 65536	// corpus bytes sampled
+#define EINDEX_SAMPLE 256	// zeros between the select samples
+
+/*
+ * the Elias-Fano list for one byte value - the offsets are in words
+ *  from the start of the index words
+ */
+struct eindex_list
+{
+    uint64_t count;		// positions in the list
+    uint64_t low_bits;		// bits of each position in the low array
+    uint64_t low;		// the packed low bits
+    uint64_t high;		// the unary high bits: a one per position and
+				//  a zero at the end of each bucket
+    uint64_t high_bits;
+    uint64_t samples;		// the bit of every EINDEX_SAMPLE'th zero
+};
+
+struct eindex_header
+{
+    char magic[8];
+    uint64_t size_corpus;
+    uint64_t fingerprint;	// of a sample of the corpus bytes
+    uint64_t words;		// words after the header
+    struct eindex_list lists[256];
+};
+
+struct eindex
+{
+    struct eindex_header *header;
+    const uint64_t *words;
+    size_t size;		// bytes in all
+    bool mapped;
+};
+
+extern struct eindex *eindex_build(const unsigned char *corpus,
+				   uint64_t size_corpus);
+extern struct eindex *eindex_open(const char *filename,
+				  const unsigned char *corpus,
+				  uint64_t size_corpus);
+extern bool eindex_write(const struct eindex *index, const char *filename);
+extern void eindex_close(struct eindex *index);
+extern int64_t eindex_next(const struct eindex *index, unsigned char c,
+			   int64_t position);
+extern void eindex_report(FILE *fp, char *argv0, const struct eindex *index);
+
+#endif
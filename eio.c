@@ -0,0 +1,307 @@
+/*
+ * eio.c: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  the reader and writer threads - see eio.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "eio.h"
+
+static void
+queue_put(struct eio_queue *queue, struct eio_buffer *buffer)
+{
+    unsigned long head = queue->head;
+
+    // never full - there are only EIO_BUFFERS buffers
+    queue->slots[head % EIO_BUFFERS] = buffer;
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    ewait_wake(&queue->wait);
+}
+
+static bool
+queue_ready(void *arg)
+{
+    struct eio_queue *queue = (struct eio_queue *) arg;
+
+    return __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) != queue->tail;
+}
+
+static struct eio_buffer *
+queue_take(struct eio_queue *queue)
+{
+    unsigned long tail = queue->tail;
+    struct eio_buffer *buffer;
+
+    ewait_until(&queue->wait, queue_ready, queue);
+    buffer = queue->slots[tail % EIO_BUFFERS];
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+
+    return buffer;
+}
+
+static ssize_t
+read_some(int fd, unsigned char *data, size_t length)
+{
+    ssize_t n;
+
+    do
+	n = read(fd, data, length);
+    while (n == -1 && errno == EINTR);
+
+    return n;
+}
+
+static bool
+write_all(int fd, const unsigned char *data, size_t length)
+{
+    while (length > 0)
+    {
+	ssize_t n = write(fd, data, length);
+
+	if (n == -1 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return false;
+	data += n;
+	length -= n;
+    }
+
+    return true;
+}
+
+static void *
+reader_thread(void *arg)
+{
+    struct eio *io = (struct eio *) arg;
+    struct eio_buffer *buffer;
+
+    do
+    {
+	buffer = queue_take(&io->empty);
+	buffer->length = read_some(io->fd, buffer->data, EIO_BUFFER);
+	if (buffer->length == -1)
+	{
+	    __atomic_store_n(&io->failed, true, __ATOMIC_RELEASE);
+	    buffer->length = 0;
+	}
+	queue_put(&io->full, buffer);
+    } while (buffer->length != 0);
+
+    return NULL;
+}
+
+static void *
+writer_thread(void *arg)
+{
+    struct eio *io = (struct eio *) arg;
+    struct eio_buffer *buffer;
+
+    while ((buffer = queue_take(&io->full))->length != -1)
+    {
+	// after a failure keep taking buffers so the loop is not held up
+	if (__atomic_load_n(&io->failed, __ATOMIC_ACQUIRE) == false &&
+	    write_all(io->fd, buffer->data, buffer->length) == false)
+	    __atomic_store_n(&io->failed, true, __ATOMIC_RELEASE);
+	queue_put(&io->empty, buffer);
+    }
+
+    return NULL;
+}
+
+struct eio *
+eio_open(char *argv0, FILE *fp, bool writing, bool threaded)
+{
+    struct eio *io;
+
+    io = (struct eio *) calloc(1, sizeof(struct eio));
+    if (io == NULL)
+    {
+	fprintf(stderr, "%s: out of memory for the input and output buffers\n",
+		argv0);
+	exit(1);
+    }
+    io->argv0 = argv0;
+    io->writing = writing;
+    io->threaded = threaded;
+    if (writing)
+	fflush(fp);
+    io->fd = fileno(fp);
+    ewait_init(&io->full.wait);
+    ewait_init(&io->empty.wait);
+
+    for (int i = 0; i < (threaded ? EIO_BUFFERS : 1); i++)
+    {
+	io->buffers[i].data = malloc(EIO_BUFFER);
+	if (io->buffers[i].data == NULL)
+	{
+	    fprintf(stderr, "%s: out of memory for the input and output buffers\n",
+		    argv0);
+	    exit(1);
+	}
+    }
+
+    // the loop holds one buffer and the rest wait in the empty queue
+    io->buffer = &io->buffers[0];
+    io->data = io->buffer->data;
+    io->length = writing ? EIO_BUFFER : 0;
+    if (threaded)
+    {
+	for (int i = writing ? 1 : 0; i < EIO_BUFFERS; i++)
+	    queue_put(&io->empty, &io->buffers[i]);
+	if (writing == false)
+	    io->buffer = NULL;
+
+	if (pthread_create(&io->thread, NULL,
+			   writing ? writer_thread : reader_thread, io) != 0)
+	{
+	    fprintf(stderr, "%s: cannot create the %s thread\n", argv0,
+		    writing ? "writer" : "reader");
+	    exit(1);
+	}
+    }
+
+    return io;
+}
+
+/*
+ * the buffer is used up - take the next one
+ */
+int
+eio_fill(struct eio *io)
+{
+    if (io->end)
+	return EOF;
+
+    if (io->threaded)
+    {
+	if (io->buffer != NULL)
+	    queue_put(&io->empty, io->buffer);
+	io->buffer = queue_take(&io->full);
+	io->data = io->buffer->data;
+	io->length = io->buffer->length;
+    }
+    else
+    {
+	ssize_t n = read_some(io->fd, io->data, EIO_BUFFER);
+
+	if (n == -1)
+	    __atomic_store_n(&io->failed, true, __ATOMIC_RELEASE);
+	io->length = n > 0 ? n : 0;
+    }
+
+    io->position = 0;
+    if (io->length == 0)
+    {
+	io->end = true;
+	return EOF;
+    }
+
+    return io->data[io->position++];
+}
+
+/*
+ * the buffer is full - hand it to the writer
+ */
+void
+eio_drain(struct eio *io)
+{
+    io->size_output += io->position;
+    if (io->threaded)
+    {
+	io->buffer->length = io->position;
+	queue_put(&io->full, io->buffer);
+	io->buffer = queue_take(&io->empty);
+	io->data = io->buffer->data;
+    }
+    else if (__atomic_load_n(&io->failed, __ATOMIC_ACQUIRE) == false &&
+	     write_all(io->fd, io->data, io->position) == false)
+	__atomic_store_n(&io->failed, true, __ATOMIC_RELEASE);
+
+    io->position = 0;
+}
+
+// the loop holds one buffer - the others are back once written
+static bool
+flush_ready(void *arg)
+{
+    struct eio *io = (struct eio *) arg;
+
+    return __atomic_load_n(&io->empty.head, __ATOMIC_ACQUIRE) -
+	io->empty.tail == EIO_BUFFERS - 1;
+}
+
+/*
+ * hand the buffered output to the file and wait until it is written -
+ *  false if a write failed
+ */
+bool
+eio_flush(struct eio *io)
+{
+    if (io->position > 0)
+	eio_drain(io);
+
+    if (io->threaded)
+	ewait_until(&io->empty.wait, flush_ready, io);
+
+    return __atomic_load_n(&io->failed, __ATOMIC_ACQUIRE) == false;
+}
+
+/*
+ * write what is left and stop the thread - false if any read or write
+ *  failed
+ */
+bool
+eio_close(struct eio *io)
+{
+    bool ok;
+
+    if (io->writing)
+    {
+	if (io->position > 0)
+	    eio_drain(io);
+	if (io->threaded)
+	{
+	    io->buffer->length = -1;
+	    queue_put(&io->full, io->buffer);
+	    pthread_join(io->thread, NULL);
+	}
+    }
+    else if (io->threaded)
+    {
+	// the loop may stop before the end of the input
+	pthread_cancel(io->thread);
+	pthread_join(io->thread, NULL);
+    }
+
+    ok = __atomic_load_n(&io->failed, __ATOMIC_ACQUIRE) == false;
+    for (int i = 0; i < EIO_BUFFERS; i++)
+	free(io->buffers[i].data);
+    ewait_destroy(&io->full.wait);
+    ewait_destroy(&io->empty.wait);
+    free(io);
+
+    return ok;
+}
@@ -0,0 +1,110 @@
+/*
+ * eio.h: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  buffered input and output for the emap and eunmap loops
+ *
+ *  the loops read and write a byte at a time with eio_getc() and
+ *  eio_putc(), which only touch a buffer.  With threads, a reader thread
+ *  fills buffers ahead of the loop and a writer thread empties them
+ *  behind it, so the loop does not wait on the disk or the pipe.  The
+ *  buffers go around two single producer, single consumer queues - full
+ *  and empty - so none are allocated after the start and a slow side
+ *  holds the other back once all of the buffers are in its queue.
+ *
+ *  input is read with read(2) on the file descriptor, so the FILE must
+ *  not have buffered input of its own.  Output flushes the FILE first.
+ */
+#ifndef EIO_H
+#define EIO_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "ewait.h"
+
+#define EIO_BUFFER (1024 * 1024)
+#define EIO_BUFFERS 4
+
+struct eio_buffer
+{
+    unsigned char *data;
+    ssize_t length;		// -1 stops the writer thread
+};
+
+/*
+ * a queue of buffers with one thread putting and one taking
+ */
+struct eio_queue
+{
+    struct eio_buffer *slots[EIO_BUFFERS];
+    unsigned long head;		// buffers put
+    unsigned long tail;		// buffers taken
+    struct ewait wait;		// the taker sleeps here when it is empty
+};
+
+struct eio
+{
+    unsigned char *data;	// the buffer the loop is using
+    size_t position;
+    size_t length;
+    struct eio_buffer *buffer;
+    int fd;
+    bool writing;
+    bool threaded;
+    bool failed;		// set by the threads - atomic loads and stores
+    bool end;			// the input is finished
+    off_t size_output;		// bytes handed to the writer
+    struct eio_queue full;
+    struct eio_queue empty;
+    struct eio_buffer buffers[EIO_BUFFERS];
+    pthread_t thread;
+    char *argv0;
+};
+
+extern struct eio *eio_open(char *argv0, FILE *fp, bool writing, bool threaded);
+extern bool eio_close(struct eio *io);
+extern int eio_fill(struct eio *io);
+extern void eio_drain(struct eio *io);
+extern bool eio_flush(struct eio *io);
+
+/*
+ * the next input byte or EOF
+ */
+static inline int
+eio_getc(struct eio *io)
+{
+    if (io->position < io->length)
+	return io->data[io->position++];
+    return eio_fill(io);
+}
+
+static inline void
+eio_putc(struct eio *io, unsigned char c)
+{
+    if (io->position == EIO_BUFFER)
+	eio_drain(io);
+    io->data[io->position++] = c;
+}
+
+#endif
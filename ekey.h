@@ -0,0 +1,73 @@
+/*
+ * ekey.h: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  corpus keys made without a -key
+ *
+ *  a corpus made without a -key used to be seeded from the time of day
+ *  after a sleep of one second, so that back to back corpora differ.
+ *  The kernel random number source needs no wait.  ecorpus -count makes
+ *  the keys of several corpora from one master key.
+ */
+#ifndef EKEY_H
+#define EKEY_H
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/random.h>
+
+/*
+ * a key from the kernel random number source - never 0, which means no key
+ */
+static inline uint64_t
+ekey_random(void)
+{
+    uint64_t key = 0;
+    struct timespec now;
+
+    if (getrandom(&key, sizeof(key), 0) != sizeof(key))
+    {
+	clock_gettime(CLOCK_REALTIME, &now);
+	key = ((uint64_t) now.tv_sec << 32) ^ now.tv_nsec ^
+	    ((uint64_t) getpid() << 16);
+    }
+
+    return key != 0 ? key : 1;
+}
+
+/*
+ * the key of corpus i made from a master key - splitmix64 of the master
+ *  key and i, cut to the 32 bits of a -key.  Never 0.
+ */
+static inline unsigned int
+ekey_derive(uint64_t master, unsigned int i)
+{
+    uint64_t z = master + (uint64_t) (i + 1) * 0x9e3779b97f4a7c15ULL;
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z = (z ^ (z >> 31)) & 0xffffffffULL;
+    return z != 0 ? z : 1;
+}
+
+#endif
@@ -23,7 +23,7 @@ SOFTWARE.
 
  * map source file through a corpus file for purposes of encryption
  */
-#define _POSIX_C_SOURCE 1
+#define _POSIX_C_SOURCE 200809L
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -34,78 +34,1149 @@ SOFTWARE.
 #include <sys/mman.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <dirent.h>
+#include <pthread.h>
+#include "estats.h"
+#include "emap_kernel.h"
+#include "earchive.h"
+#include "esync.h"
+#include "estate.h"
+#include "ecorpus_tokens.h"
+#include "eindex.h"
+#include "efingerprint.h"
+#include "ecompress.h"
+#include "eio.h"
 
-extern void ecorpus_tokens_init(char *argv0, char *stream_file);
-extern unsigned char ecorpus_next_token ();
+void
+fail(char *argv0)
+{
+    fprintf(stderr, "%s: run the program with three arguments\n", argv0);
+    fprintf(stderr, "  %s corpusfilename inputfilename outputfilename\n",
+	    argv0);
+    fprintf(stderr, "  %s: use \"-start N\" to start reading after the first N bytes of the corpus file\n", argv0);
+    fprintf(stderr, "  %s: use \"-stats\" or \"-stats_json\" to report counters on standard error\n", argv0);
+    fprintf(stderr, "  %s: use \"-sync N\" to write a sync point every N bytes for eunmap -range\n", argv0);
+    fprintf(stderr, "  %s: use \"-sync_file name\" to name the sync point file - outputfilename.sync\n", argv0);
+    fprintf(stderr, "  %s: use \"-pipeline\" to generate a stream: corpus on its own thread\n", argv0);
+    fprintf(stderr, "  %s: use \"-index\" to search the corpus file with a position index\n", argv0);
+    fprintf(stderr, "  %s: use \"-index_file name\" to keep the position index in a file\n", argv0);
+    fprintf(stderr, "  %s: use \"-fingerprint\" to start the output with a corpus fingerprint for eunmap\n", argv0);
+    fprintf(stderr, "  %s: use \"-compress\" or \"-compress_level N\" to gzip the input on its own thread first\n", argv0);
+    fprintf(stderr, "  %s: use \"-serial_io\" to read and write on the encoding thread\n", argv0);
+    fprintf(stderr, "  %s: use \"-state N\" to save the state every N bytes for -resume and -append\n", argv0);
+    fprintf(stderr, "  %s: use \"-state_file name\" to name the state file - outputfilename.state\n", argv0);
+    fprintf(stderr, "  %s: use \"-resume\" to continue an interrupted run from the state file\n", argv0);
+    fprintf(stderr, "  %s: use \"-append\" to add the input to the end of the output of the state file\n", argv0);
+    fprintf(stderr, "  %s -batch listfile|directory corpusfilename outputdirectory\n", argv0);
+    fprintf(stderr, "  %s: use \"-threads N\" to set the number of -batch worker threads\n", argv0);
+    fprintf(stderr, "  %s -archive -batch listfile|directory corpusfilename archivefilename\n", argv0);
+    exit(1);
+}
+
+/*
+ * search the windows of a stream ring for the next c
+ *
+ *  the same search as emap_search() but the tokens come from the ring.
+ *  The tokens up to the match are consumed.  memchr() finds the
+ *  candidates so the window is searched a word or a vector at a time.
+ */
+static off_t
+ring_search(struct ecorpus_ring *ring, off_t size_corpus, off_t index_corpus,
+	    unsigned char c)
+{
+    const unsigned char *window;
+    const unsigned char *match;
+    size_t length;
+    off_t distance = 0;	// tokens consumed
+
+    while (index_corpus + distance + 1 < size_corpus)
+    {
+	window = ecorpus_ring_window(ring, &length);
+	if (length > size_corpus - (index_corpus + distance + 1))
+	    length = size_corpus - (index_corpus + distance + 1);
+
+	match = window;
+	while ((match = memchr(match, c, window + length - match)) != NULL)
+	{
+	    off_t distance_corpus = distance + (match - window) + 1;
+
+	    match++;
+	    if (distance_corpus != c)
+	    {
+		ecorpus_ring_consume(ring, match - window);
+		ESTATS_ADD(corpus_bytes_scanned, distance_corpus);
+		return distance_corpus;
+	    }
+	    ESTATS_ADD(same_byte_skips, 1);
+	}
+
+	ecorpus_ring_consume(ring, length);
+	distance += length;
+    }
+    ESTATS_ADD(corpus_bytes_scanned, distance);
+
+    return -1;
+}
+
+/*
+ * the encode loop
+ *
+ *  the corpus source and the kind of input do not change during a run.
+ *  encode() is inlined into one copy for each combination with those two
+ *  as constants, so the per byte tests on them drop out of the loops.
+ *  main() picks the copy once from encode_loops[].
+ */
+enum encode_source
+{
+    ENCODE_FILE,	// a mapped corpus file
+    ENCODE_STREAM,	// a stream: corpus generated inline
+    ENCODE_RING,	// a stream: corpus generated by emap -pipeline
+    ENCODE_INDEX,	// a mapped corpus file searched with emap -index
+    ENCODE_SOURCES
+};
+
+struct encode
+{
+    const unsigned char *corpus;
+    struct ecorpus_stream *stream;
+    struct ecorpus_ring *ring;
+    struct eindex *index;
+    off_t size_corpus;
+    off_t size_input;
+    off_t start;
+    struct eio *input;
+    struct eio *output;
+    FILE *fp_sync;
+    unsigned long sync_interval;
+    char *state_filename;
+    off_t state_interval;
+    off_t state_next;		// plaintext offset of the next checkpoint
+    uint64_t state_check;
+    off_t index_corpus;		// where the loop starts - and stopped
+    off_t size_output;
+    off_t size_plain;
+    char *argv0;
+    char *corpus_name;
+    char *output_name;
+};
+
+/*
+ * save the state at a -state checkpoint
+ *
+ *  the output and the sync points up to the checkpoint are on the disk
+ *  before the state file is replaced, so the state never runs ahead of
+ *  the output.
+ */
+static void __attribute__((noinline, cold))
+encode_checkpoint(struct encode *e, off_t index_corpus)
+{
+    struct estate state = { e->size_plain, e->size_output, index_corpus,
+			    e->state_check };
+
+    // fdatasync() fails on a pipe - there is nothing to wait for
+    if (eio_flush(e->output) == false)
+    {
+	fprintf(stderr, "%s: cannot write the output file: %s\n",
+		e->argv0, e->output_name);
+	exit(1);
+    }
+    fdatasync(e->output->fd);
+
+    if (e->fp_sync != NULL &&
+	(fflush(e->fp_sync) != 0 || fdatasync(fileno(e->fp_sync)) != 0))
+    {
+	fprintf(stderr, "%s: cannot write the sync file\n", e->argv0);
+	exit(1);
+    }
+
+    if (estate_write(e->state_filename, &state) == false)
+    {
+	fprintf(stderr, "%s: cannot write the state file: %s\n",
+		e->argv0, e->state_filename);
+	exit(1);
+    }
+    e->state_next += e->state_interval;
+}
+
+/*
+ * the distance from index_corpus to the next c - or -1 at the end of the
+ *  corpus.  A byte is never encoded as its own value.
+ */
+static inline __attribute__((always_inline)) off_t
+encode_search(struct encode *e, const enum encode_source source,
+	      off_t index_corpus, unsigned char c)
+{
+    unsigned char c_corpus;
+
+    if (source == ENCODE_RING)
+	return ring_search(e->ring, e->size_corpus, index_corpus, c);
+
+    if (source == ENCODE_INDEX)
+    {
+	int64_t index_corpus2 = index_corpus;
+
+	while ((index_corpus2 = eindex_next(e->index, c, index_corpus2)) != -1)
+	{
+	    if (c != (index_corpus2 - index_corpus))
+		return index_corpus2 - index_corpus;
+	    ESTATS_ADD(same_byte_skips, 1);
+	}
+	return -1;
+    }
+
+    if (source == ENCODE_FILE)
+    {
+	const unsigned char *found = e->corpus + index_corpus;
+	const unsigned char *end = e->corpus + e->size_corpus;
+	const unsigned char *from;
+
+	if (index_corpus + 1 >= e->size_corpus)
+	    return -1;
+
+	for (;;)
+	{
+	    from = found + 1;
+	    found = ecpu_find(from, end - from, c);
+	    if (found == NULL)
+	    {
+		ESTATS_ADD(corpus_bytes_scanned, end - from);
+		return -1;
+	    }
+	    ESTATS_ADD(corpus_bytes_scanned, found + 1 - from);
+
+	    // do not replace with the same  byte
+	    if (c != (found - e->corpus) - index_corpus)
+		return (found - e->corpus) - index_corpus;
+	    ESTATS_ADD(same_byte_skips, 1);
+	}
+    }
+
+    for (off_t index_corpus2 = index_corpus + 1;
+	 index_corpus2 < e->size_corpus;
+	 index_corpus2++)
+    {
+	ESTATS_ADD(corpus_bytes_scanned, 1);
+	c_corpus = ecorpus_next_token(e->stream);
+
+	if (c == c_corpus)
+	{
+	    // do not replace with the same  byte
+	    if (c != (index_corpus2 - index_corpus))
+		return index_corpus2 - index_corpus;
+	    ESTATS_ADD(same_byte_skips, 1);
+	}
+    }
+
+    return -1;
+}
+
+static inline __attribute__((always_inline)) void
+encode(struct encode *e, const enum encode_source source,
+       const bool redirect_stdin)
+{
+    unsigned char token;
+    unsigned char c;
+    off_t index_corpus = e->index_corpus;
+    off_t distance_corpus;
+    off_t count;
+    int byte;
+
+    for (off_t i = 0; redirect_stdin || i < e->size_input; i++)
+    {
+	byte = eio_getc(e->input);
+	if (redirect_stdin && byte == EOF)
+	    break;
+	c = byte & 0377;
+	ESTATS_ADD(input_bytes, 1);
+
+	if (e->fp_sync != NULL && e->size_plain % e->sync_interval == 0)
+	    esync_write(e->fp_sync, e->size_plain, e->size_output, index_corpus);
+	if (e->size_plain == e->state_next)
+	    encode_checkpoint(e, index_corpus);
+	e->size_plain++;
+
+	/*
+	 * search for the next token location
+	 */
+	distance_corpus = encode_search(e, source, index_corpus, c);
+
+	/*
+	 * none found - wrap around the corpus
+	 *
+	 * zero is not a distance - does not occur - zero zero: wrap around
+	 */
+	if (distance_corpus == -1)
+	{
+	    // zero zero meansing rewind the corpus
+	    token = 0;
+	    eio_putc(e->output, token);
+	    token = 0;
+	    eio_putc(e->output, token);
+	    ESTATS_ADD(wraps, 1);
+	    ESTATS_ADD(output_bytes, 2);
+	    e->size_output += 2;
+	    index_corpus = e->start;
+
+	    distance_corpus = encode_search(e, source, index_corpus, c);
+	    if (distance_corpus == -1)
+	    {
+		fprintf(stderr, "%s: Bailing on byte %d - cannot map file %s\n",
+			e->argv0, c, e->corpus_name);
+		fprintf(stderr, "%s: Bailing: try inceasing the corpus size\n",
+			e->argv0);
+		fail(e->argv0);
+	    }
+	}
+	index_corpus += distance_corpus;
+
+	/*
+	 * write out the distance_corpus
+	 *
+	 * distances greater than 255 are encoded as counts of 255
+	 */
+	if (distance_corpus > 255)
+	{
+	    ESTATS_ADD(long_distances, 1);
+	    ESTATS_ADD(escape_bytes, 2);
+	    ESTATS_ADD(output_bytes, 2);
+	    e->size_output += 2;
+	    token = 0;
+	    eio_putc(e->output, token);
+
+	    while(distance_corpus > 255)
+	    {
+		count = distance_corpus / 255;
+		if (count > 255)
+		    count = 255;
+
+		distance_corpus = distance_corpus - (count * 255);
+		token = count;
+		eio_putc(e->output, token);
+		ESTATS_ADD(escape_bytes, 1);
+		ESTATS_ADD(output_bytes, 1);
+		e->size_output++;
+	    }
+
+	    token = 0;
+	    eio_putc(e->output, token);
+	}
+	token = distance_corpus;  // can be zero
+	eio_putc(e->output, token);
+	ESTATS_ADD(output_bytes, 1);
+	e->size_output++;
+    }
+    e->index_corpus = index_corpus;
+}
+
+#define ENCODE_LOOP(name, source, redirect_stdin) \
+    static void name(struct encode *e) { encode(e, source, redirect_stdin); }
+
+ENCODE_LOOP(encode_file, ENCODE_FILE, false)
+ENCODE_LOOP(encode_file_stdin, ENCODE_FILE, true)
+ENCODE_LOOP(encode_stream, ENCODE_STREAM, false)
+ENCODE_LOOP(encode_stream_stdin, ENCODE_STREAM, true)
+ENCODE_LOOP(encode_ring, ENCODE_RING, false)
+ENCODE_LOOP(encode_ring_stdin, ENCODE_RING, true)
+ENCODE_LOOP(encode_index, ENCODE_INDEX, false)
+ENCODE_LOOP(encode_index_stdin, ENCODE_INDEX, true)
+
+static void (*const encode_loops[ENCODE_SOURCES][2])(struct encode *) =
+{
+    { encode_file, encode_file_stdin },
+    { encode_stream, encode_stream_stdin },
+    { encode_ring, encode_ring_stdin },
+    { encode_index, encode_index_stdin },
+};
+
+/*
+ * batch mode - encrypt many files with one mapping of the corpus
+ *
+ *  each file is given its own region of the corpus.  Regions are taken in
+ *  turn from the start of the corpus so no two files use the same corpus
+ *  bytes.  The region size is estimated from the corpus byte counts; a
+ *  file which wraps in its region is encrypted again in a larger one.
+ *  Worker threads take the next file from the list until none are left.
+ *
+ *  with -archive the outputs are written into one archive file with an
+ *  index at the end - see earchive.h.
+ */
+#define BATCH_ATTEMPTS 8
+
+struct batch_file
+{
+    char *input;
+    off_t size_input;
+    off_t start;
+    off_t offset;	// in the archive
+    off_t size_output;
+    unsigned long wraps;
+    bool failed;
+};
+
+static struct batch_file *batch_files = NULL;
+static unsigned long batch_count = 0;
+static unsigned long batch_next = 0;
+static off_t batch_offset = 0;	// the first corpus byte not given out
+static unsigned char *batch_corpus;
+static off_t batch_size_corpus;
+static double batch_mean_distance[256];
+static char *batch_outdir;
+static int batch_archive_fd = -1;
+static off_t batch_archive_end = 0;	// the first archive byte not given out
+static char *batch_argv0;
+
+static void
+batch_add(char *filename)
+{
+    if (batch_count % 1024 == 0)
+    {
+	batch_files = realloc(batch_files,
+			      (batch_count + 1024) * sizeof(struct batch_file));
+	if (batch_files == NULL)
+	{
+	    fprintf(stderr, "%s: out of memory for the -batch list\n",
+		    batch_argv0);
+	    exit(1);
+	}
+    }
+
+    memset(&batch_files[batch_count], 0, sizeof(struct batch_file));
+    batch_files[batch_count].input = strdup(filename);
+    batch_count++;
+}
+
+static void
+batch_add_directory(char *directory)
+{
+    DIR *dir;
+    struct dirent *entry;
+    struct stat s;
+    char path[4096];
+
+    dir = opendir(directory);
+    if (dir == NULL)
+    {
+	fprintf(stderr, "%s: cannot read the directory: %s\n",
+		batch_argv0, directory);
+	exit(1);
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+	if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+	    continue;
+
+	snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+	if (stat(path, &s) != 0)
+	    continue;
+
+	if (S_ISDIR(s.st_mode))
+	    batch_add_directory(path);
+	else if (S_ISREG(s.st_mode))
+	    batch_add(path);
+    }
+
+    closedir(dir);
+}
+
+/*
+ * take the next region of the corpus - false when the corpus is used up
+ */
+static bool
+batch_reserve(off_t length, off_t *start)
+{
+    off_t offset = __atomic_fetch_add(&batch_offset, length, __ATOMIC_RELAXED);
+
+    if (offset + length > batch_size_corpus || offset > UINT_MAX)
+	return false;
+
+    *start = offset;
+    return true;
+}
+
+/*
+ * the corpus bytes given out after -start
+ */
+static off_t
+batch_used(off_t start)
+{
+    off_t end = batch_offset < batch_size_corpus ? batch_offset : batch_size_corpus;
+
+    return end > start ? end - start : 0;
+}
+
+/*
+ * map the input through the corpus region [start, limit) as emap does
+ *
+ *  returns the output length or -1 when a byte is not in the region
+ */
+static off_t
+batch_encode(unsigned char *input, off_t size_input, off_t start, off_t limit,
+	     unsigned char **output, off_t *output_size, unsigned long *wraps)
+{
+    off_t index_corpus = start;
+    off_t distance_corpus;
+    off_t length = 0;
+    bool wrapping = false;
+
+    *wraps = 0;
+    for (off_t i = 0; i < size_input; )
+    {
+	distance_corpus = emap_search(batch_corpus, limit, index_corpus, input[i]);
+
+	if (distance_corpus == -1)
+	{
+	    if (wrapping)
+		return -1;
+	    distance_corpus = 0;	// zero zero: rewind the corpus
+	    index_corpus = start;
+	    wrapping = true;
+	    (*wraps)++;
+	}
+	else
+	{
+	    index_corpus += distance_corpus;
+	    wrapping = false;
+	    i++;
+	}
+
+	if (length + emap_distance_length(limit) + 1 > *output_size)
+	{
+	    *output_size = (*output_size + emap_distance_length(limit)) * 2;
+	    *output = realloc(*output, *output_size);
+	    if (*output == NULL)
+	    {
+		fprintf(stderr, "%s: out of memory for the -batch output\n",
+			batch_argv0);
+		exit(1);
+	    }
+	}
+
+	if (wrapping && distance_corpus == 0)
+	{
+	    (*output)[length++] = 0;
+	    (*output)[length++] = 0;
+	    continue;
+	}
+	length += emap_put_distance(*output + length, distance_corpus);
+    }
+
+    return length;
+}
+
+static void
+batch_file_run(struct batch_file *file, unsigned char **output,
+	       off_t *output_size)
+{
+    unsigned char *input = NULL;
+    char output_name[4096];
+    double estimate = 1024;
+    off_t length;
+    off_t region;
+    struct stat s;
+    FILE *fp;
+    int fd;
+
+    file->failed = true;
+
+    fd = open(file->input, O_RDONLY);
+    if (fd == -1 || fstat(fd, &s) != 0)
+    {
+	fprintf(stderr, "%s: cannot read the input file: %s\n",
+		batch_argv0, file->input);
+	return;
+    }
+    file->size_input = s.st_size;
+    if (file->size_input > 0)
+	input = (unsigned char *) mmap(0, file->size_input, PROT_READ,
+				       MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (input == MAP_FAILED)
+    {
+	fprintf(stderr, "%s: cannot map the input file: %s\n",
+		batch_argv0, file->input);
+	return;
+    }
+
+    /*
+     * the expected corpus bytes used - with room to spare
+     */
+    for (off_t i = 0; i < file->size_input; i++)
+	estimate += batch_mean_distance[input[i]];
+    region = (off_t) (estimate * 1.25);
+
+    length = (file->size_input == 0) ? 0 : -1;
+    for (int attempt = 0; attempt < BATCH_ATTEMPTS && length != 0; attempt++)
+    {
+	if (batch_reserve(region, &file->start) == false)
+	    break;
+
+	length = batch_encode(input, file->size_input, file->start,
+			      file->start + region, output, output_size,
+			      &file->wraps);
+	if (length != -1 && file->wraps == 0)
+	    break;
+	region *= 2;
+    }
+
+    if (file->size_input > 0)
+	munmap(input, file->size_input);
+
+    if (length == -1)
+    {
+	fprintf(stderr, "%s: cannot map file %s - try increasing the corpus size\n",
+		batch_argv0, file->input);
+	return;
+    }
+
+    if (file->wraps != 0)
+	fprintf(stderr, "%s: %s wraps %lu times in its corpus region\n",
+		batch_argv0, file->input, file->wraps);
+
+    if (batch_archive_fd != -1)
+    {
+	file->offset = __atomic_fetch_add(&batch_archive_end, length,
+					  __ATOMIC_RELAXED);
+	for (off_t written = 0, n; written < length; written += n)
+	{
+	    n = pwrite(batch_archive_fd, *output + written, length - written,
+		       file->offset + written);
+	    if (n <= 0)
+	    {
+		fprintf(stderr, "%s: cannot write the archive: %s\n",
+			batch_argv0, batch_outdir);
+		return;
+	    }
+	}
+	file->size_output = length;
+	file->failed = false;
+	return;
+    }
+
+    snprintf(output_name, sizeof(output_name), "%s/%06lu.emap", batch_outdir,
+	     (unsigned long) (file - batch_files));
+    fp = fopen(output_name, "wb");
+    if (fp == NULL || fwrite(*output, 1, length, fp) != length)
+    {
+	fprintf(stderr, "%s: cannot write the output file: %s\n",
+		batch_argv0, output_name);
+	if (fp != NULL)
+	    fclose(fp);
+	return;
+    }
+    fclose(fp);
+
+    file->size_output = length;
+    file->failed = false;
+}
+
+static void *
+batch_worker(void *arg)
+{
+    unsigned char *output = NULL;
+    off_t output_size = 0;
+
+    while (true)
+    {
+	unsigned long next = __atomic_fetch_add(&batch_next, 1,
+						__ATOMIC_RELAXED);
+
+	if (next >= batch_count)
+	    break;
+	batch_file_run(&batch_files[next], &output, &output_size);
+    }
+
+    free(output);
+    return NULL;
+}
+
+/*
+ * append the archive index and footer after the last member
+ */
+static bool
+batch_write_index(void)
+{
+    unsigned char entry[EARCHIVE_ENTRY_SIZE];
+    unsigned char footer[EARCHIVE_FOOTER_SIZE];
+    uint64_t members = 0;
+    FILE *fp;
+
+    if (lseek(batch_archive_fd, batch_archive_end, SEEK_SET) == -1)
+	return false;
+    fp = fdopen(batch_archive_fd, "w");
+    if (fp == NULL)
+	return false;
+
+    for (unsigned long i = 0; i < batch_count; i++)
+    {
+	struct batch_file *file = &batch_files[i];
+	size_t name_length = strlen(file->input);
+
+	if (file->failed)
+	    continue;
+	earchive_put(entry, file->offset, 8);
+	earchive_put(entry + 8, file->size_output, 8);
+	earchive_put(entry + 16, file->start, 8);
+	earchive_put(entry + 24, file->size_input, 8);
+	earchive_put(entry + 32, name_length, 4);
+	fwrite(entry, 1, sizeof(entry), fp);
+	fwrite(file->input, 1, name_length, fp);
+	members++;
+    }
+
+    memcpy(footer, EARCHIVE_MAGIC, EARCHIVE_MAGIC_SIZE);
+    earchive_put(footer + EARCHIVE_MAGIC_SIZE, batch_archive_end, 8);
+    earchive_put(footer + EARCHIVE_MAGIC_SIZE + 8, members, 8);
+    fwrite(footer, 1, sizeof(footer), fp);
+
+    return fclose(fp) == 0;
+}
+
+/*
+ * the output directory gets one NNNNNN.emap file per input and a
+ *  manifest with a line per file:
+ *    start input-size output-size NNNNNN.emap input-filename
+ *
+ *  or with -archive the output is a single archive file
+ */
+static int
+batch(char *argv0, char *list, char *corpus_filename, char *outdir,
+      unsigned long threads, bool archive, off_t start)
+{
+    struct stat s;
+    unsigned long counts[256];
+    char manifest[4096];
+    pthread_t *tids;
+    FILE *fp;
+    int fd;
+    int failures = 0;
+
+    batch_argv0 = argv0;
+    batch_outdir = outdir;
+    batch_offset = start;	// the regions follow -start
+
+    if (stat(list, &s) == 0 && S_ISDIR(s.st_mode))
+	batch_add_directory(list);
+    else
+    {
+	char line[4096];
+
+	fp = fopen(list, "r");
+	if (fp == NULL)
+	{
+	    fprintf(stderr, "%s: cannot read the -batch list: %s\n", argv0, list);
+	    fail(argv0);
+	}
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+	    int len = strlen(line);
+
+	    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+		line[--len] = '\0';
+	    if (len > 0)
+		batch_add(line);
+	}
+	fclose(fp);
+    }
+
+    if (strncmp("stream:", corpus_filename, 7) == 0)
+    {
+	fprintf(stderr, "%s: -batch needs a corpus file - not a stream\n", argv0);
+	fail(argv0);
+    }
+
+    fd = open(corpus_filename, O_RDONLY);
+    if (fd == -1)
+    {
+	fprintf(stderr, "%s: cannot read the corpus file: %s\n",
+		argv0, corpus_filename);
+	fail(argv0);
+    }
+    fstat(fd, &s);
+    batch_size_corpus = s.st_size;
+    batch_corpus = (unsigned char *) mmap(0, batch_size_corpus, PROT_READ,
+					  MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (batch_size_corpus == 0 || batch_corpus == MAP_FAILED)
+    {
+	fprintf(stderr, "%s: cannot map the corpus file: %s\n",
+		argv0, corpus_filename);
+	fail(argv0);
+    }
+
+    /*
+     * the mean distance to each byte value in the corpus
+     */
+    for (int i = 0; i < 256; i++)
+	counts[i] = 0;
+    for (off_t i = 0; i < batch_size_corpus; i++)
+	counts[batch_corpus[i]]++;
+    for (int i = 0; i < 256; i++)
+	batch_mean_distance[i] = counts[i] ?
+	    (double) batch_size_corpus / counts[i] : batch_size_corpus;
+
+    if (archive)
+    {
+	batch_archive_fd = open(outdir, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (batch_archive_fd == -1)
+	{
+	    fprintf(stderr, "%s: cannot create the archive: %s\n",
+		    argv0, outdir);
+	    fail(argv0);
+	}
+    }
+    else if (mkdir(outdir, 0777) != 0 && (stat(outdir, &s) != 0 ||
+					    S_ISDIR(s.st_mode) == 0))
+    {
+	fprintf(stderr, "%s: cannot create the output directory: %s\n",
+		argv0, outdir);
+	fail(argv0);
+    }
+
+    tids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+    for (unsigned long i = 0; i < threads; i++)
+	if (pthread_create(&tids[i], NULL, batch_worker, NULL) != 0)
+	{
+	    fprintf(stderr, "%s: cannot create the batch thread\n", argv0);
+	    exit(1);
+	}
+    for (unsigned long i = 0; i < threads; i++)
+	pthread_join(tids[i], NULL);
+    free(tids);
+
+    if (archive)
+    {
+	if (batch_write_index() == false)
+	{
+	    fprintf(stderr, "%s: cannot write the archive index: %s\n",
+		    argv0, outdir);
+	    exit(1);
+	}
+	for (unsigned long i = 0; i < batch_count; i++)
+	    if (batch_files[i].failed)
+		failures++;
+	fprintf(stderr, "%s: archived %lu of %lu files using %ld corpus bytes\n",
+		argv0, batch_count - failures, batch_count,
+		(long) batch_used(start));
+	return failures == 0 ? 0 : 1;
+    }
+
+    snprintf(manifest, sizeof(manifest), "%s/manifest", outdir);
+    fp = fopen(manifest, "w");
+    if (fp == NULL)
+    {
+	fprintf(stderr, "%s: cannot create the manifest: %s\n", argv0, manifest);
+	exit(1);
+    }
+
+    for (unsigned long i = 0; i < batch_count; i++)
+    {
+	struct batch_file *file = &batch_files[i];
+
+	if (file->failed)
+	{
+	    failures++;
+	    continue;
+	}
+	fprintf(fp, "%ld %ld %ld %06lu.emap %s\n", (long) file->start,
+		(long) file->size_input, (long) file->size_output, i,
+		file->input);
+    }
+    fclose(fp);
+
+    fprintf(stderr, "%s: encrypted %lu of %lu files using %ld corpus bytes\n",
+	    argv0, batch_count - failures, batch_count,
+	    (long) batch_used(start));
+
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned char *corpus = NULL;
+
+    int fd_corpus = 0;
+    struct stat s;
+    off_t size_corpus = UINT_MAX;
+    off_t size_input;
+    unsigned long start = 0;
+    struct ecorpus_stream *stream = NULL;
+
+    bool redirect_stdin = false;
+    FILE *fp_input;
+    FILE *fp_output;
+
+    struct encode e;
+
+    bool stats = false;
+    bool stats_json = false;
+    char *batch_list = NULL;
+    bool archive = false;
+    bool pipeline = false;
+    bool serial_io = false;
+    struct ecorpus_ring *ring = NULL;
+    bool use_index = false;
+    char *index_filename = NULL;
+    struct eindex *index = NULL;
+    bool fingerprint = false;
+    int compress_level = 0;
+    struct ecompress *codec = NULL;
+    FILE *fp_plain = NULL;
+    unsigned long sync_interval = 0;
+    char *sync_filename = NULL;
+    char sync_name[4096];
+    FILE *fp_sync = NULL;
+    unsigned long state_interval = 0;
+    char *state_filename = NULL;
+    char state_name[4096];
+    bool resume = false;
+    bool append = false;
+    bool use_state;
+    struct estate state = { 0, 0, 0, 0 };
+    uint64_t check = 0;
+    off_t index_start;
+    unsigned long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    char *args[4] = { "", "", "", ""};
+    int argsc = 1;
+
+    ESTATS_PHASE(ESTATS_SETUP);
+
+    /*
+     * parse the arguments to the program
+     */
+    args[0] = argv[0];
+    for (unsigned int i = 1; i < argc; i++)
+    {
+	if (argsc >= 4)
+	    fail(args[0]);
+
+	if (strcmp(argv[i], "-start") == 0)
+	{
+	    unsigned int rvalue;
+	    unsigned long scan_token;
+
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -start value given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    rvalue = sscanf(argv[i + 1], "%lu", &scan_token);
+	    if (rvalue == 0 || rvalue == EOF || scan_token > UINT_MAX)
+	    {
+		fprintf(stderr, "%s: -start value (%s) is not an integer in the range of 0 to %u\n",
+			argv[0], argv[i + 1], UINT_MAX);
+		fail(argv[0]);
+	    }
+
+	    start = scan_token;
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-stats") == 0)
+	{
+	    stats = true;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-stats_json") == 0)
+	{
+	    stats = true;
+	    stats_json = true;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-sync") == 0)
+	{
+	    unsigned int rvalue;
+	    unsigned long scan_token;
+
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -sync value given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    rvalue = sscanf(argv[i + 1], "%lu", &scan_token);
+	    if (rvalue == 0 || rvalue == EOF || scan_token == 0 || scan_token > UINT_MAX)
+	    {
+		fprintf(stderr, "%s: -sync value (%s) is not an integer in the range of 1 to %u\n",
+			argv[0], argv[i + 1], UINT_MAX);
+		fail(argv[0]);
+	    }
+
+	    sync_interval = scan_token;
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-sync_file") == 0)
+	{
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -sync_file name given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    sync_filename = argv[i + 1];
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-state") == 0)
+	{
+	    unsigned int rvalue;
+	    unsigned long scan_token;
+
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -state value given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    rvalue = sscanf(argv[i + 1], "%lu", &scan_token);
+	    if (rvalue == 0 || rvalue == EOF || scan_token == 0 || scan_token > UINT_MAX)
+	    {
+		fprintf(stderr, "%s: -state value (%s) is not an integer in the range of 1 to %u\n",
+			argv[0], argv[i + 1], UINT_MAX);
+		fail(argv[0]);
+	    }
+
+	    state_interval = scan_token;
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-state_file") == 0)
+	{
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -state_file name given\n", argv[0]);
+		fail(argv[0]);
+	    }
 
-void
-fail(char *argv0)
-{
-    fprintf(stderr, "%s: run the program with three arguments\n", argv0);
-    fprintf(stderr, "  %s corpusfilename inputfilename outputfilename\n",
-	    argv0);
-    fprintf(stderr, "  %s: use \"-start N\" to start reading after the first N bytes of the corpus file\n", argv0);
-    exit(1);
-}
+	    state_filename = argv[i + 1];
+	    i++;
+	    continue;
+	}
 
-int main(int argc, char *argv[])
-{
-    unsigned char *corpus = NULL;
+	if (strcmp(argv[i], "-resume") == 0)
+	{
+	    resume = true;
+	    continue;
+	}
 
-    int fd_corpus = 0;
-    struct stat s;
-    off_t size_corpus = UINT_MAX;
-    off_t size_input;
-    unsigned long start = 0;
-    bool streaming_corpus = false;
+	if (strcmp(argv[i], "-append") == 0)
+	{
+	    append = true;
+	    continue;
+	}
 
-    bool redirect_stdin = false;
-    FILE *fp_input;
-    FILE *fp_output;
+	if (strcmp(argv[i], "-batch") == 0)
+	{
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -batch list given\n", argv[0]);
+		fail(argv[0]);
+	    }
 
-    unsigned char token;
+	    batch_list = argv[i + 1];
+	    i++;
+	    continue;
+	}
 
-    unsigned char c;
-    unsigned char c_corpus;
-    off_t index_corpus;
-    off_t index_test;
-    off_t distance_corpus;
+	if (strcmp(argv[i], "-archive") == 0)
+	{
+	    archive = true;
+	    continue;
+	}
 
-    off_t count;
-    bool wrapping;
+	if (strcmp(argv[i], "-pipeline") == 0)
+	{
+	    pipeline = true;
+	    continue;
+	}
 
-    char *args[4] = { "", "", "", ""};
-    int argsc = 1;
+	if (strcmp(argv[i], "-serial_io") == 0)
+	{
+	    serial_io = true;
+	    continue;
+	}
 
-    /*
-     * parse the arguments to the program
-     */
-    args[0] = argv[0];
-    for (unsigned int i = 1; i < argc; i++)
-    {
-	if (argsc >= 4)
-	    fail(args[0]);
+	if (strcmp(argv[i], "-fingerprint") == 0)
+	{
+	    fingerprint = true;
+	    continue;
+	}
 
-	if (strcmp(argv[i], "-start") == 0)
+	if (strcmp(argv[i], "-compress") == 0)
+	{
+	    compress_level = ECOMPRESS_LEVEL;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-compress_level") == 0)
+	{
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -compress_level value given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    if (sscanf(argv[i + 1], "%d", &compress_level) != 1 ||
+		compress_level < 1 || compress_level > 9)
+	    {
+		fprintf(stderr, "%s: -compress_level value (%s) is not an integer in the range of 1 to 9\n",
+			argv[0], argv[i + 1]);
+		fail(argv[0]);
+	    }
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-index") == 0)
+	{
+	    use_index = true;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-index_file") == 0)
+	{
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -index_file name given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    use_index = true;
+	    index_filename = argv[i + 1];
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-threads") == 0)
 	{
 	    unsigned int rvalue;
 	    unsigned long scan_token;
 
 	    if  (argc <= i + 1)
 	    {
-		fprintf(stderr, "%s: no -start value given\n", argv[0]);
+		fprintf(stderr, "%s: no -threads value given\n", argv[0]);
 		fail(argv[0]);
 	    }
 
 	    rvalue = sscanf(argv[i + 1], "%lu", &scan_token);
-	    if (rvalue == 0 || rvalue == EOF || scan_token > UINT_MAX)
+	    if (rvalue == 0 || rvalue == EOF || scan_token == 0 || scan_token > 1024)
 	    {
-		fprintf(stderr, "%s: -start value (%s) is not an integer in the range of 0 to %u\n",
-			argv[0], argv[i + 1], UINT_MAX);
+		fprintf(stderr, "%s: -threads value (%s) is not an integer in the range of 1 to 1024\n",
+			argv[0], argv[i + 1]);
 		fail(argv[0]);
 	    }
 
-	    start = scan_token;
+	    threads = scan_token;
 	    i++;
 	    continue;
 	}
@@ -113,16 +1184,86 @@ int main(int argc, char *argv[])
 	argsc++;
     }
 
+    use_state = state_interval != 0 || state_filename != NULL || resume ||
+	append;
+
+    if (batch_list != NULL)
+    {
+	if (argsc != 3 || sync_interval != 0 || pipeline || use_index ||
+	    fingerprint || compress_level != 0 || use_state)
+	    fail(args[0]);
+	if (threads < 1)
+	    threads = 1;
+	return batch(args[0], batch_list, args[1], args[2], threads, archive,
+		     start);
+    }
+
+    if (archive)
+    {
+	fprintf(stderr, "%s: -archive needs a -batch list\n", args[0]);
+	fail(args[0]);
+    }
+
     if (argsc != 4)
 	fail(args[0]);
 
+    if (compress_level != 0 && sync_interval != 0)
+    {
+	fprintf(stderr, "%s: -sync cannot be used with -compress\n", args[0]);
+	fail(args[0]);
+    }
+
+    /*
+     * read the state file - where the last run stopped
+     */
+    if (resume && append)
+    {
+	fprintf(stderr, "%s: -resume and -append cannot be used together\n",
+		args[0]);
+	fail(args[0]);
+    }
+    if (use_state && compress_level != 0)
+    {
+	fprintf(stderr, "%s: -state cannot be used with -compress\n", args[0]);
+	fail(args[0]);
+    }
+    if ((resume || append) && strcmp("-", args[3]) == 0)
+    {
+	fprintf(stderr, "%s: -resume and -append need an output file\n",
+		args[0]);
+	fail(args[0]);
+    }
+    if (use_state && state_filename == NULL && strcmp("-", args[3]) == 0)
+    {
+	fprintf(stderr, "%s: -state with standard output needs -state_file\n",
+		args[0]);
+	fail(args[0]);
+    }
+    if (use_state && state_filename == NULL)
+    {
+	snprintf(state_name, sizeof(state_name), "%s.state", args[3]);
+	state_filename = state_name;
+    }
+    if ((resume || append) && estate_read(state_filename, &state) == false)
+    {
+	fprintf(stderr, "%s: cannot read the state file: %s\n",
+		args[0], state_filename);
+	exit(1);
+    }
+
+    if (stats && ESTATS_ENABLED == 0)
+	fprintf(stderr, "%s: -stats needs a build with the counters: make stats\n",
+		args[0]);
+
     /*
      * map the corpus file
      */
     if (strncmp("stream:", args[1], 7) == 0)
+	stream = ecorpus_tokens_open(args[0], args[1]);
+    else if (pipeline)
     {
-	ecorpus_tokens_init(args[0], args[1]);
-	streaming_corpus = true;
+	fprintf(stderr, "%s: -pipeline needs a stream: corpus\n", args[0]);
+	fail(args[0]);
     }
     else
     {
@@ -142,6 +1283,68 @@ int main(int argc, char *argv[])
 					 fd_corpus, 0);
     }
 
+    /*
+     * index the corpus - a saved index is used when it matches the corpus
+     */
+    if (use_index && stream != NULL)
+    {
+	fprintf(stderr, "%s: -index needs a corpus file, not a stream\n", args[0]);
+	fail(args[0]);
+    }
+    if (use_index)
+    {
+	if (index_filename != NULL)
+	    index = eindex_open(index_filename, corpus, size_corpus);
+	if (index == NULL)
+	{
+	    index = eindex_build(corpus, size_corpus);
+	    if (index == NULL)
+	    {
+		fprintf(stderr, "%s: out of memory for the corpus index\n",
+			args[0]);
+		exit(1);
+	    }
+	    if (index_filename != NULL &&
+		eindex_write(index, index_filename) == false)
+	    {
+		fprintf(stderr, "%s: cannot write the index file: %s\n",
+			args[0], index_filename);
+		exit(1);
+	    }
+	}
+	if (stats)
+	    eindex_report(stderr, args[0], index);
+    }
+
+    /*
+     * the corpus check for the fingerprint header and the state file -
+     *  a state is only continued with the corpus and -start it was made with
+     */
+    if (fingerprint || compress_level != 0 || use_state)
+    {
+	uint64_t corpus_fingerprint;
+
+	if (stream != NULL)
+	{
+	    if (efingerprint_stream(args[1], &corpus_fingerprint) == false)
+	    {
+		fprintf(stderr, "%s: cannot read the stream file: %s\n",
+			args[0], args[1]);
+		exit(1);
+	    }
+	}
+	else
+	    corpus_fingerprint = efingerprint_corpus(corpus, size_corpus);
+	check = efingerprint_check(corpus_fingerprint, start);
+    }
+    if ((resume || append) && state.check != check)
+    {
+	fprintf(stderr, "%s: the state file is for another corpus or -start: %s\n",
+		args[0], state_filename);
+	exit(1);
+    }
+    index_start = resume || append ? state.index : (off_t) start;
+
     /*
      * map the input file
      */
@@ -165,13 +1368,41 @@ int main(int argc, char *argv[])
 	// Get the size of the input file
 	fstat (fileno(fp_input), &s);
 	size_input = s.st_size;
+
+	// skip what the interrupted run encrypted
+	if (resume)
+	{
+	    if (state.plain > size_input)
+	    {
+		fprintf(stderr, "%s: the input file is shorter than the state: %s\n",
+			args[0], args[2]);
+		exit(1);
+	    }
+	    lseek(fileno(fp_input), state.plain, SEEK_SET);
+	    size_input -= state.plain;
+	}
+    }
+
+    /*
+     * compress the input on its own thread - the loop reads the pipe
+     *  until it is closed
+     */
+    if (compress_level != 0)
+    {
+	fp_plain = fp_input;
+	codec = ecompress_start(args[0], fp_plain, compress_level, &fp_input);
+	redirect_stdin = true;
+	size_input = INT_MAX;
+	fingerprint = true;
     }
 
     /*
-     * open the output file
+     * open the output file - -resume and -append cut it back to the state
      */
     if (strcmp("-", args[3]) == 0)
 	fp_output = stdout;
+    else if (resume || append)
+	fp_output = fopen(args[3], "r+b");
     else
 	fp_output = fopen(args[3], "wb");
 
@@ -182,115 +1413,179 @@ int main(int argc, char *argv[])
 	fail(args[0]);
     }
 
-    /*
-     * adjust the start - if it is set
-     */
-    index_corpus = start;
-    if (streaming_corpus)
+    if (resume || append)
     {
-	for (int i = 0; i <= start; i++)
-	    ecorpus_next_token();
+	fstat(fileno(fp_output), &s);
+	if (s.st_size < state.cipher ||
+	    ftruncate(fileno(fp_output), state.cipher) != 0 ||
+	    fseeko(fp_output, state.cipher, SEEK_SET) != 0)
+	{
+	    fprintf(stderr, "%s: the output file is shorter than the state: %s\n",
+		    args[0], args[3]);
+	    exit(1);
+	}
     }
 
     /*
-     * loop through the input finding corpus token distances
+     * open the sync point file
      */
-    wrapping = false;
-    for (off_t i = 0; i < size_input; )
+    if (sync_interval != 0)
     {
-	if (wrapping == false)
+	if (sync_filename == NULL && strcmp("-", args[3]) == 0)
 	{
-	    c = fgetc(fp_input) & 0377;
-	    if (redirect_stdin && feof(fp_input))
-		break;
+	    fprintf(stderr, "%s: -sync with standard output needs -sync_file\n",
+		    args[0]);
+	    fail(args[0]);
+	}
+	if (sync_filename == NULL)
+	{
+	    snprintf(sync_name, sizeof(sync_name), "%s.sync", args[3]);
+	    sync_filename = sync_name;
 	}
 
-	/*
-	 * search for the next token location
-	 */
-	distance_corpus = -1;
-	for (off_t index_corpus2 = index_corpus + 1;
-	     index_corpus2 < size_corpus;
-	     index_corpus2++)
+	fp_sync = fopen(sync_filename, resume || append ? "r+" : "w");
+	if (fp_sync == NULL)
+	{
+	    fprintf(stderr, "%s: cannot create the sync file: %s\n",
+		    args[0], sync_filename);
+	    fail(args[0]);
+	}
+
+	// keep the records before the state - the same -sync N is needed
+	if (resume || append)
 	{
-	    if (streaming_corpus)
-		c_corpus = ecorpus_next_token();
-	    else
-		c_corpus = corpus[index_corpus2];
+	    off_t records = (state.plain + sync_interval - 1) / sync_interval;
 
-	    if (c == c_corpus)
+	    fstat(fileno(fp_sync), &s);
+	    if (s.st_size < records * ESYNC_RECORD_SIZE ||
+		ftruncate(fileno(fp_sync), records * ESYNC_RECORD_SIZE) != 0 ||
+		fseeko(fp_sync, records * ESYNC_RECORD_SIZE, SEEK_SET) != 0)
 	    {
-		// do not replace with the same  byte
-		index_test = c;
-
-		if (index_test != (index_corpus2 - index_corpus))
-		{
-		    distance_corpus = index_corpus2 - index_corpus;
-		    index_corpus = index_corpus2;
-		    if (redirect_stdin == false)
-			i++;
-		    wrapping = false;
-		    break;
-		}
+		fprintf(stderr, "%s: the sync file is shorter than the state: %s\n",
+			args[0], sync_filename);
+		exit(1);
 	    }
 	}
+    }
 
-	/*
-	 * none found - wrap around the corpus
-	 *
-	 * zero is not a distance - does not occur - zero zero: wrap around
-	 */
-	if (distance_corpus == -1)
-	{
-	    if (wrapping == true)
+    /*
+     * adjust the start - if it is set
+     */
+    ESTATS_PHASE(ESTATS_SEEK);
+    if (stream != NULL)
+	ecorpus_tokens_seek(stream, index_start + 1);
+    if (stream != NULL && pipeline)
+	ring = ecorpus_ring_open(stream, ECORPUS_RING_SIZE);
+
+    /*
+     * the fingerprint header - see efingerprint.h
+     */
+    e.size_output = 0;
+    if (resume || append)
+	e.size_output = state.cipher;
+    else if (fingerprint)
+    {
+	unsigned char header[EFINGERPRINT_SIZE];
+
+	efingerprint_put(header,
+			 codec != NULL ? EFINGERPRINT_GZIP : EFINGERPRINT_PLAIN,
+			 check);
+	fwrite(header, 1, EFINGERPRINT_SIZE, fp_output);
+	e.size_output = EFINGERPRINT_SIZE;
+    }
+
+    /*
+     * loop through the input finding corpus token distances
+     */
+    ESTATS_PHASE(ESTATS_LOOP);
+    e.corpus = corpus;
+    e.stream = stream;
+    e.ring = ring;
+    e.index = index;
+    e.size_corpus = size_corpus;
+    e.size_input = size_input;
+    e.start = start;
+    e.input = eio_open(args[0], fp_input, false, serial_io == false);
+    e.output = eio_open(args[0], fp_output, true, serial_io == false);
+    e.fp_sync = fp_sync;
+    e.sync_interval = sync_interval;
+    e.state_filename = state_filename;
+    e.state_interval = state_interval;
+    e.state_check = check;
+    e.index_corpus = index_start;
+    e.size_plain = resume || append ? state.plain : 0;
+    e.argv0 = args[0];
+    e.corpus_name = args[1];
+    e.output_name = args[3];
+
+    // a new run replaces an old state first - then the next checkpoint
+    e.state_next = -1;
+    if (use_state && resume == false && append == false)
+	encode_checkpoint(&e, index_start);
+    if (state_interval != 0)
+	e.state_next = (e.size_plain / state_interval + 1) * state_interval;
+    if (resume && redirect_stdin)
+	for (off_t i = 0; i < state.plain; i++)
+	    if (eio_getc(e.input) == EOF)
 	    {
-		fprintf(stderr, "%s: Bailing on byte %d - cannot map file %s\n",
-			args[0], c, args[1]);
-		fprintf(stderr, "%s: Bailing: try inceasing the corpus size\n",
+		fprintf(stderr, "%s: the input is shorter than the state\n",
 			args[0]);
-		fail(args[0]);
+		exit(1);
 	    }
-	    // zero zero meansing rewind the corpus
-	    token = 0;
-	    fputc(token, fp_output);
-	    token = 0;
-	    fputc(token, fp_output);
-	    index_corpus = start;
-	    wrapping = true;
-	    continue;
-	}
 
-	/*
-	 * write out the distance_corpus
-	 *
-	 * distances greater than 255 are encoded as counts of 255
-	 */
-	if (distance_corpus > 255)
-	{
-	    token = 0;
-	    fputc(token, fp_output);
+    encode_loops[ring != NULL ? ENCODE_RING :
+		 stream != NULL ? ENCODE_STREAM :
+		 index != NULL ? ENCODE_INDEX : ENCODE_FILE][redirect_stdin](&e);
 
-	    while(distance_corpus > 255)
-	    {
-		count = distance_corpus / 255;
-		if (count > 255)
-		    count = 255;
+    if (eio_close(e.input) == false)
+    {
+	fprintf(stderr, "%s: cannot read the input file: %s\n",
+		args[0], args[2]);
+	exit(1);
+    }
+    if (eio_close(e.output) == false)
+    {
+	fprintf(stderr, "%s: cannot write the output file: %s\n",
+		args[0], args[3]);
+	exit(1);
+    }
 
-		distance_corpus = distance_corpus - (count * 255);
-		token = count;
-		fputc(token, fp_output);
-	    }
+    if (fp_sync != NULL && fclose(fp_sync) != 0)
+    {
+	fprintf(stderr, "%s: cannot write the sync file: %s\n",
+		args[0], sync_filename);
+	exit(1);
+    }
 
-	    token = 0;
-	    fputc(token, fp_output);
+    // the output is complete - the state is where -append carries on
+    if (use_state)
+    {
+	state.plain = e.size_plain;
+	state.cipher = e.size_output;
+	state.index = e.index_corpus;
+	state.check = check;
+	fdatasync(fileno(fp_output));
+	if (estate_write(state_filename, &state) == false)
+	{
+	    fprintf(stderr, "%s: cannot write the state file: %s\n",
+		    args[0], state_filename);
+	    exit(1);
 	}
-	token = distance_corpus;  // can be zero
-	fputc(token, fp_output);
     }
-
+    ecorpus_ring_close(ring);
+    eindex_close(index);
     fclose(fp_output);
     fclose(fp_input);
+    if (codec != NULL)
+    {
+	if (ecompress_finish(codec) == false)
+	    exit(1);
+	fclose(fp_plain);
+    }
     close(fd_corpus);
 
+    if (stats)
+	ESTATS_REPORT(stderr, args[0], stats_json);
+
     return 0;
 }
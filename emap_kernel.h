@@ -0,0 +1,111 @@
+/*
+ * emap_kernel.h: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  the corpus search and distance encoding shared by emap and its tools
+ */
+#ifndef EMAP_KERNEL_H
+#define EMAP_KERNEL_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "ecpu.h"
+
+/*
+ * find the distance from index_corpus to the next c in the corpus
+ *
+ *  a byte is never encoded as its own value - that match is passed over.
+ *  -1 is returned when the end of the corpus is reached.  The corpus is
+ *  scanned by ecpu_find() - see ecpu.h.
+ */
+static inline off_t
+emap_search(const unsigned char *corpus, off_t size_corpus, off_t index_corpus,
+	    unsigned char c)
+{
+    const unsigned char *found = corpus + index_corpus;
+    const unsigned char *end = corpus + size_corpus;
+
+    // a -start at or past the end leaves nothing to scan
+    if (index_corpus + 1 >= size_corpus)
+	return -1;
+
+    while ((found = ecpu_find(found + 1, end - found - 1, c)) != NULL)
+    {
+	if (c != (found - corpus) - index_corpus)
+	    return (found - corpus) - index_corpus;
+    }
+
+    return -1;
+}
+
+/*
+ * the number of output bytes for a distance
+ *
+ *  distances greater than 255 are escaped: zero, counts of 255 up to 255
+ *  each, zero and the remainder
+ */
+static inline off_t
+emap_distance_length(off_t distance_corpus)
+{
+    off_t length = 1;
+
+    if (distance_corpus > 255)
+    {
+	off_t counts = (distance_corpus - 1) / 255;	// the 255s to remove
+
+	length += 2 + (counts + 254) / 255;
+    }
+
+    return length;
+}
+
+/*
+ * write the escaped distance - out must hold emap_distance_length() bytes
+ */
+static inline int
+emap_put_distance(unsigned char *out, off_t distance_corpus)
+{
+    off_t count;
+    int length = 0;
+
+    if (distance_corpus > 255)
+    {
+	out[length++] = 0;
+
+	while(distance_corpus > 255)
+	{
+	    count = distance_corpus / 255;
+	    if (count > 255)
+		count = 255;
+
+	    distance_corpus = distance_corpus - (count * 255);
+	    out[length++] = count;
+	}
+
+	out[length++] = 0;
+    }
+    out[length++] = distance_corpus;  // can be zero
+
+    return length;
+}
+
+#endif
@@ -0,0 +1,612 @@
+/*
+ * emicro.c: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  time each hot kernel on its own
+ *
+ *  each kernel is run -warmup times untimed and then -runs times timed.
+ *  The report gives the median, 99th percentile, mean, standard deviation
+ *  and minimum of the run times, and the throughput at the median.  It is
+ *  printed as text and can be written as CSV or JSON.
+ *
+ *  the kernels:
+ *    search          emap_search() for each input byte, as in emap
+ *    parse           eparse_positions() over the emap output of the input
+ *    gather          eparse_gather() of those positions, as in eunmap
+ *    tokens_OPTIONS  ecorpus_next_token() for a stream with those options
+ *    histogram       etally's count of the byte values in the corpus
+ *
+ *  the bytes reported for the search are the corpus bytes scanned, for
+ *  the parse the emap output bytes and for the tokens the tokens.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <limits.h>
+#include <stdbool.h>
+#include "emap_kernel.h"
+#include "eparse.h"
+#include "ecorpus_tokens.h"
+
+#define MICRO_RUNS 15
+#define MICRO_WARMUP 3
+#define MICRO_TOKENS 1000000
+
+void
+fail(char *argv0)
+{
+    fprintf(stderr, "%s: run the program with two arguments\n", argv0);
+    fprintf(stderr, "  %s [ OPTIONS ] corpusfilename inputfilename\n", argv0);
+    fprintf(stderr, "  %s: use \"-kernel name\" to run the kernels whose names start with name\n", argv0);
+    fprintf(stderr, "  %s: use \"-runs N\" to time each kernel N times - %d\n", argv0, MICRO_RUNS);
+    fprintf(stderr, "  %s: use \"-warmup N\" to run each kernel N times first - %d\n", argv0, MICRO_WARMUP);
+    fprintf(stderr, "  %s: use \"-tokens N\" to generate N tokens a run - %d\n", argv0, MICRO_TOKENS);
+    fprintf(stderr, "  %s: use \"-csv filename\" to write the results as CSV\n", argv0);
+    fprintf(stderr, "  %s: use \"-json filename\" to write the results as JSON\n", argv0);
+    exit(1);
+}
+
+/*
+ * the data the kernels share - built once before any are timed
+ */
+struct micro
+{
+    unsigned char *corpus;
+    off_t size_corpus;
+    unsigned char *input;
+    off_t size_input;
+    unsigned char *cipher;	// the emap output of the input
+    size_t size_cipher;
+    off_t *positions;		// the corpus positions of the cipher
+    size_t count_positions;
+    unsigned char *plain;
+    struct ecorpus_stream *stream;
+    unsigned long tokens;
+    unsigned long long sum;	// for micro_sum
+};
+
+// the kernel results end up here so they are not optimized away
+volatile unsigned long long micro_sum;
+
+struct kernel
+{
+    char *name;
+    char *options;	// the stream options of a tokens kernel
+    unsigned long long (*run)(struct micro *m);
+};
+
+struct result
+{
+    char *name;
+    int runs;
+    unsigned long long bytes;
+    double median;
+    double p99;
+    double mean;
+    double stddev;
+    double min;
+};
+
+static unsigned long long
+kernel_search(struct micro *m)
+{
+    off_t index_corpus = 0;
+    unsigned long long scanned = 0;
+
+    for (off_t i = 0; i < m->size_input; i++)
+    {
+	off_t distance = emap_search(m->corpus, m->size_corpus, index_corpus,
+				     m->input[i]);
+
+	if (distance == -1)
+	{
+	    scanned += m->size_corpus - index_corpus;
+	    index_corpus = 0;
+	    distance = emap_search(m->corpus, m->size_corpus, 0, m->input[i]);
+	}
+	scanned += distance;
+	index_corpus += distance;
+    }
+    m->sum += index_corpus;
+
+    return scanned;
+}
+
+/*
+ * the last bytes which eparse_positions() leaves to eunmap's byte at a
+ *  time loop are left out
+ */
+static unsigned long long
+kernel_parse(struct micro *m)
+{
+    off_t index_corpus = 0;
+    size_t count = 0;
+    size_t p = 0;
+    size_t used;
+
+    while (p < m->size_cipher)
+    {
+	size_t n = eparse_positions(m->cipher + p, m->size_cipher - p, &used,
+				    &index_corpus, 0, m->size_corpus,
+				    m->positions + count, EPARSE_BATCH);
+
+	if (used == 0)
+	    break;
+	p += used;
+	count += n;
+    }
+    m->count_positions = count;
+    m->sum += index_corpus;
+
+    return p;
+}
+
+static unsigned long long
+kernel_gather(struct micro *m)
+{
+    eparse_gather(m->corpus, m->positions, m->count_positions, m->plain, 0);
+    m->sum += m->plain[m->count_positions / 2];
+
+    return m->count_positions;
+}
+
+static unsigned long long
+kernel_tokens(struct micro *m)
+{
+    for (unsigned long i = 0; i < m->tokens; i++)
+	m->sum += ecorpus_next_token(m->stream);
+
+    return m->tokens;
+}
+
+static unsigned long long
+kernel_histogram(struct micro *m)
+{
+    unsigned long long bytes[256];
+
+    for (int i = 0; i < 256; i++)
+	bytes[i] = 0;
+
+    for (off_t i = 0; i < m->size_corpus; i++)
+	bytes[m->corpus[i]]++;
+    m->sum += bytes[m->sum & 0377];
+
+    return m->size_corpus;
+}
+
+/*
+ * the byte_list in the stream options is a file of the input's byte values
+ */
+static struct kernel kernels[] =
+{
+    { "search", NULL, kernel_search },
+    { "parse", NULL, kernel_parse },
+    { "gather", NULL, kernel_gather },
+    { "tokens_random", "-key 4787\n", kernel_tokens },
+    { "tokens_uniform", "-key 4787\n-uniform\n", kernel_tokens },
+    { "tokens_byte_list", "-key 4787\n-byte_list %s\n", kernel_tokens },
+    { "tokens_byte_list_uniform", "-key 4787\n-byte_list %s\n-uniform\n",
+      kernel_tokens },
+    { "tokens_weighted", "-key 4787\n-byte_list %s\n-weighted\n",
+      kernel_tokens },
+    { "tokens_skip", "-key 4787\n-skip 3\n", kernel_tokens },
+    { "tokens_skip_random", "-key 4787\n-skip_random\n", kernel_tokens },
+    { "tokens_bulk", "-key 4787\n-engine bulk\n", kernel_tokens },
+    { "tokens_bulk_uniform", "-key 4787\n-engine bulk\n-uniform\n",
+      kernel_tokens },
+    { "tokens_bulk_weighted",
+      "-key 4787\n-engine bulk\n-byte_list %s\n-weighted\n", kernel_tokens },
+    { "tokens_bulk_skip_random", "-key 4787\n-engine bulk\n-skip_random\n",
+      kernel_tokens },
+    { "histogram", NULL, kernel_histogram },
+};
+
+static unsigned char *
+map_file(char *argv0, char *filename, off_t *size)
+{
+    struct stat s;
+    unsigned char *data;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd == -1)
+    {
+	fprintf(stderr, "%s: cannot read the file: %s\n", argv0, filename);
+	fail(argv0);
+    }
+
+    fstat(fd, &s);
+    *size = s.st_size;
+    if (*size == 0)
+    {
+	fprintf(stderr, "%s: the file is empty: %s\n", argv0, filename);
+	fail(argv0);
+    }
+
+    data = (unsigned char *) mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+	fprintf(stderr, "%s: cannot map the file: %s\n", argv0, filename);
+	exit(1);
+    }
+    close(fd);
+
+    return data;
+}
+
+static void *
+micro_alloc(char *argv0, size_t size)
+{
+    void *data = malloc(size > 0 ? size : 1);
+
+    if (data == NULL)
+    {
+	fprintf(stderr, "%s: out of memory\n", argv0);
+	exit(1);
+    }
+
+    return data;
+}
+
+/*
+ * encode the input as emap does - the parse and gather kernels decode it
+ */
+static void
+micro_encode(char *argv0, struct micro *m)
+{
+    size_t size = m->size_input * 2 + 64;
+    off_t index_corpus = 0;
+
+    m->cipher = micro_alloc(argv0, size);
+    m->size_cipher = 0;
+    for (off_t i = 0; i < m->size_input; i++)
+    {
+	off_t distance = emap_search(m->corpus, m->size_corpus, index_corpus,
+				     m->input[i]);
+
+	if (distance == -1)
+	{
+	    m->cipher[m->size_cipher++] = 0;
+	    m->cipher[m->size_cipher++] = 0;
+	    index_corpus = 0;
+	    distance = emap_search(m->corpus, m->size_corpus, 0, m->input[i]);
+	    if (distance == -1)
+	    {
+		fprintf(stderr, "%s: byte %d of the input is not in the corpus\n",
+			argv0, m->input[i]);
+		exit(1);
+	    }
+	}
+	index_corpus += distance;
+
+	if (m->size_cipher + emap_distance_length(distance) + 2 > size)
+	{
+	    size *= 2;
+	    m->cipher = realloc(m->cipher, size);
+	    if (m->cipher == NULL)
+	    {
+		fprintf(stderr, "%s: out of memory\n", argv0);
+		exit(1);
+	    }
+	}
+	m->size_cipher += emap_put_distance(m->cipher + m->size_cipher,
+					    distance);
+    }
+
+    m->positions = micro_alloc(argv0, m->size_input * sizeof(off_t));
+    m->plain = micro_alloc(argv0, m->size_input);
+    kernel_parse(m);
+}
+
+static double
+micro_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int
+compare_seconds(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * warm up, time the runs and reduce them to the result
+ */
+static void
+micro_run(struct kernel *kernel, struct micro *m, int warmup, int runs,
+	  struct result *result)
+{
+    double seconds[runs];
+    double sum = 0;
+    double squares = 0;
+
+    for (int i = 0; i < warmup; i++)
+	kernel->run(m);
+
+    for (int i = 0; i < runs; i++)
+    {
+	double started = micro_now();
+
+	result->bytes = kernel->run(m);
+	seconds[i] = micro_now() - started;
+	sum += seconds[i];
+    }
+
+    qsort(seconds, runs, sizeof(double), compare_seconds);
+    result->name = kernel->name;
+    result->runs = runs;
+    result->min = seconds[0];
+    result->median = runs % 2 ? seconds[runs / 2] :
+	(seconds[runs / 2 - 1] + seconds[runs / 2]) / 2;
+    result->p99 = seconds[(int) ceil(0.99 * runs) - 1];
+    result->mean = sum / runs;
+    for (int i = 0; i < runs; i++)
+	squares += (seconds[i] - result->mean) * (seconds[i] - result->mean);
+    result->stddev = runs > 1 ? sqrt(squares / (runs - 1)) : 0.0;
+}
+
+static double
+megabytes(struct result *result)
+{
+    return result->median > 0 ? result->bytes / result->median / 1e6 : 0.0;
+}
+
+static FILE *
+open_report(char *argv0, char *filename)
+{
+    FILE *fp = fopen(filename, "w");
+
+    if (fp == NULL)
+    {
+	fprintf(stderr, "%s: cannot create the file: %s\n", argv0, filename);
+	exit(1);
+    }
+
+    return fp;
+}
+
+static void
+report_text(FILE *fp, struct result *results, int count)
+{
+    for (int i = 0; i < count; i++)
+	fprintf(fp, "%-24s runs %d  median %.6f  p99 %.6f  mean %.6f  stddev %.6f  min %.6f  MB/s %.1f\n",
+		results[i].name, results[i].runs, results[i].median,
+		results[i].p99, results[i].mean, results[i].stddev,
+		results[i].min, megabytes(&results[i]));
+}
+
+static void
+report_csv(FILE *fp, struct result *results, int count)
+{
+    fprintf(fp, "kernel,runs,bytes,median_seconds,p99_seconds,mean_seconds,stddev_seconds,min_seconds,mb_per_second\n");
+    for (int i = 0; i < count; i++)
+	fprintf(fp, "%s,%d,%llu,%.9f,%.9f,%.9f,%.9f,%.9f,%.3f\n",
+		results[i].name, results[i].runs, results[i].bytes,
+		results[i].median, results[i].p99, results[i].mean,
+		results[i].stddev, results[i].min, megabytes(&results[i]));
+}
+
+static void
+report_json(FILE *fp, struct result *results, int count)
+{
+    fprintf(fp, "[\n");
+    for (int i = 0; i < count; i++)
+	fprintf(fp, "{\"kernel\": \"%s\", \"runs\": %d, \"bytes\": %llu, \"median_seconds\": %.9f, \"p99_seconds\": %.9f, \"mean_seconds\": %.9f, \"stddev_seconds\": %.9f, \"min_seconds\": %.9f, \"mb_per_second\": %.3f}%s\n",
+		results[i].name, results[i].runs, results[i].bytes,
+		results[i].median, results[i].p99, results[i].mean,
+		results[i].stddev, results[i].min, megabytes(&results[i]),
+		i + 1 < count ? "," : "");
+    fprintf(fp, "]\n");
+}
+
+/*
+ * a new file under $TMPDIR or /tmp - its name is put in name
+ */
+static FILE *
+temp_file(char *argv0, char name[PATH_MAX])
+{
+    char *tmpdir = getenv("TMPDIR");
+    FILE *fp;
+    int fd;
+
+    snprintf(name, PATH_MAX, "%s/emicro.XXXXXX",
+	     tmpdir != NULL ? tmpdir : "/tmp");
+    fd = mkstemp(name);
+    if (fd == -1 || (fp = fdopen(fd, "w")) == NULL)
+    {
+	fprintf(stderr, "%s: cannot create a file in %s\n", argv0,
+		tmpdir != NULL ? tmpdir : "/tmp");
+	exit(1);
+    }
+
+    return fp;
+}
+
+int main(int argc, char *argv[])
+{
+    struct micro m = { .tokens = MICRO_TOKENS };
+    int count_kernels = sizeof(kernels) / sizeof(kernels[0]);
+    struct result results[sizeof(kernels) / sizeof(kernels[0])];
+    int count = 0;
+    char *kernel = NULL;
+    char *csv_filename = NULL;
+    char *json_filename = NULL;
+    int runs = MICRO_RUNS;
+    int warmup = MICRO_WARMUP;
+    char byte_list[PATH_MAX];
+    char options[PATH_MAX];
+    char stream[PATH_MAX + 8];
+    bool seen[256] = { false };
+    FILE *fp;
+
+    char *args[3] = { "", "", "" };
+    int argsc = 1;
+
+    /*
+     * parse the arguments to the program
+     */
+    args[0] = argv[0];
+    for (int i = 1; i < argc; i++)
+    {
+	if (strcmp(argv[i], "-kernel") == 0 || strcmp(argv[i], "-csv") == 0 ||
+	    strcmp(argv[i], "-json") == 0)
+	{
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no %s value given\n", argv[0], argv[i]);
+		fail(argv[0]);
+	    }
+
+	    if (strcmp(argv[i], "-kernel") == 0)
+		kernel = argv[i + 1];
+	    else if (strcmp(argv[i], "-csv") == 0)
+		csv_filename = argv[i + 1];
+	    else
+		json_filename = argv[i + 1];
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-runs") == 0 || strcmp(argv[i], "-warmup") == 0 ||
+	    strcmp(argv[i], "-tokens") == 0)
+	{
+	    unsigned long scan_token;
+
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no %s value given\n", argv[0], argv[i]);
+		fail(argv[0]);
+	    }
+
+	    if (sscanf(argv[i + 1], "%lu", &scan_token) != 1 ||
+		scan_token > 1000000000 ||
+		(scan_token == 0 && strcmp(argv[i], "-warmup") != 0))
+	    {
+		fprintf(stderr, "%s: %s value (%s) is not an integer in the range of %d to 1000000000\n",
+			argv[0], argv[i], argv[i + 1],
+			strcmp(argv[i], "-warmup") != 0);
+		fail(argv[0]);
+	    }
+
+	    if (strcmp(argv[i], "-runs") == 0)
+		runs = scan_token;
+	    else if (strcmp(argv[i], "-warmup") == 0)
+		warmup = scan_token;
+	    else
+		m.tokens = scan_token;
+	    i++;
+	    continue;
+	}
+
+	if (argsc >= 3)
+	    fail(args[0]);
+	args[argsc] = argv[i];
+	argsc++;
+    }
+
+    if (argsc != 3)
+	fail(args[0]);
+
+    m.corpus = map_file(args[0], args[1], &m.size_corpus);
+    m.input = map_file(args[0], args[2], &m.size_input);
+    micro_encode(args[0], &m);
+
+    // the byte values of the input for the byte_list options
+    fp = temp_file(args[0], byte_list);
+    for (off_t i = 0; i < m.size_input; i++)
+    {
+	if (seen[m.input[i]] == false)
+	    fputc(m.input[i], fp);
+	seen[m.input[i]] = true;
+    }
+    fclose(fp);
+
+    for (int i = 0; i < count_kernels; i++)
+    {
+	if (kernel != NULL &&
+	    strncmp(kernels[i].name, kernel, strlen(kernel)) != 0)
+	    continue;
+
+	if (kernels[i].options != NULL)
+	{
+	    fp = temp_file(args[0], options);
+	    fprintf(fp, kernels[i].options, byte_list);
+	    fclose(fp);
+	    snprintf(stream, sizeof(stream), "stream:%s", options);
+	    m.stream = ecorpus_tokens_open(args[0], stream);
+	}
+
+	micro_run(&kernels[i], &m, warmup, runs, &results[count]);
+	count++;
+
+	if (kernels[i].options != NULL)
+	{
+	    ecorpus_tokens_close(m.stream);
+	    unlink(options);
+	}
+    }
+    unlink(byte_list);
+    micro_sum = m.sum;
+
+    if (count == 0)
+    {
+	fprintf(stderr, "%s: no kernel is named %s\n", args[0], kernel);
+	fail(args[0]);
+    }
+
+    /*
+     * the stream options are reported as the streams open - the results
+     *  follow them
+     */
+    fflush(stdout);
+    fprintf(stdout, "cpu %s\n", ecpu_names[ecpu_level]);
+    report_text(stdout, results, count);
+    if (csv_filename != NULL)
+    {
+	fp = open_report(args[0], csv_filename);
+	report_csv(fp, results, count);
+	fclose(fp);
+    }
+    if (json_filename != NULL)
+    {
+	fp = open_report(args[0], json_filename);
+	report_json(fp, results, count);
+	fclose(fp);
+    }
+
+    return 0;
+}
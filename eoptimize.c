@@ -0,0 +1,391 @@
+/*
+ * eoptimize.c: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  choose the corpus and -start offset which give the smallest emap output
+ *
+ *  every candidate corpus is tried at evenly spaced start offsets.  The
+ *  candidates are shared out to worker threads.  Each candidate is mapped
+ *  as emap would map it and the output size and wraps are counted.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "emap_kernel.h"
+
+void
+fail(char *argv0)
+{
+    fprintf(stderr, "%s: run the program with an input file and one or more corpus files\n", argv0);
+    fprintf(stderr, "  %s [ OPTIONS ] inputfilename corpusfilename ...\n", argv0);
+    fprintf(stderr, "  %s: use \"-starts N\" to try N start offsets in each corpus (default 64)\n", argv0);
+    fprintf(stderr, "  %s: use \"-sample N\" to map only the first N bytes of the input\n", argv0);
+    fprintf(stderr, "  %s: use \"-threads N\" to set the number of worker threads\n", argv0);
+    fprintf(stderr, "  %s: use \"-top N\" to print the N best candidates (default 10)\n", argv0);
+    exit(1);
+}
+
+struct corpus
+{
+    char *filename;
+    unsigned char *data;
+    off_t size;
+};
+
+struct candidate
+{
+    int corpus;
+    off_t start;
+    off_t size_output;
+    unsigned long wraps;
+    bool failed;	// a byte is not in the corpus
+    bool pruned;	// stopped once larger than the best found
+};
+
+static struct corpus *corpora;
+static struct candidate *candidates;
+static unsigned long candidates_count;
+static unsigned long candidates_next = 0;
+static unsigned char *input;
+static off_t size_input;
+static off_t best_size = -1;	// smallest output without wraps
+
+/*
+ * map the input through one candidate as emap does - without writing
+ */
+static void
+evaluate(struct candidate *candidate)
+{
+    unsigned char *corpus = corpora[candidate->corpus].data;
+    off_t size_corpus = corpora[candidate->corpus].size;
+    off_t start = candidate->start;
+    off_t index_corpus = start;
+    off_t distance_corpus;
+    off_t size_output = 0;
+    bool wrapping = false;
+
+    for (off_t i = 0; i < size_input; )
+    {
+	distance_corpus = emap_search(corpus, size_corpus, index_corpus,
+				      input[i]);
+
+	if (distance_corpus == -1)
+	{
+	    if (wrapping)
+	    {
+		candidate->failed = true;
+		return;
+	    }
+	    size_output += 2;
+	    candidate->wraps++;
+	    index_corpus = start;
+	    wrapping = true;
+	    continue;
+	}
+
+	size_output += emap_distance_length(distance_corpus);
+	index_corpus += distance_corpus;
+	wrapping = false;
+	i++;
+
+	/*
+	 * give up on candidates which cannot beat the best so far
+	 */
+	if ((i & 4095) == 0)
+	{
+	    off_t best = __atomic_load_n(&best_size, __ATOMIC_RELAXED);
+
+	    if (best != -1 && size_output > best)
+	    {
+		candidate->pruned = true;
+		return;
+	    }
+	}
+    }
+
+    candidate->size_output = size_output;
+
+    if (candidate->wraps == 0)
+    {
+	off_t best = __atomic_load_n(&best_size, __ATOMIC_RELAXED);
+
+	while ((best == -1 || size_output < best) &&
+	       __atomic_compare_exchange_n(&best_size, &best, size_output,
+					   false, __ATOMIC_RELAXED,
+					   __ATOMIC_RELAXED) == false)
+	    ;
+    }
+}
+
+static void *
+worker(void *arg)
+{
+    while (true)
+    {
+	unsigned long next = __atomic_fetch_add(&candidates_next, 1,
+						__ATOMIC_RELAXED);
+
+	if (next >= candidates_count)
+	    break;
+	evaluate(&candidates[next]);
+    }
+
+    return NULL;
+}
+
+/*
+ * usable candidates first, then fewest wraps, then smallest output
+ */
+static int
+candidate_compare(const void *a, const void *b)
+{
+    const struct candidate *ca = a;
+    const struct candidate *cb = b;
+    bool usable_a = !ca->failed && !ca->pruned;
+    bool usable_b = !cb->failed && !cb->pruned;
+
+    if (usable_a != usable_b)
+	return usable_a ? -1 : 1;
+    if (ca->wraps != cb->wraps)
+	return ca->wraps < cb->wraps ? -1 : 1;
+    if (ca->size_output != cb->size_output)
+	return ca->size_output < cb->size_output ? -1 : 1;
+    return 0;
+}
+
+static unsigned long
+scan_number(char *argv0, char *option, char *value, unsigned long max)
+{
+    unsigned int rvalue;
+    unsigned long scan_token;
+
+    if (value == NULL)
+    {
+	fprintf(stderr, "%s: no %s value given\n", argv0, option);
+	fail(argv0);
+    }
+
+    rvalue = sscanf(value, "%lu", &scan_token);
+    if (rvalue == 0 || rvalue == EOF || scan_token == 0 || scan_token > max)
+    {
+	fprintf(stderr, "%s: %s value (%s) is not an integer in the range of 1 to %lu\n",
+		argv0, option, value, max);
+	fail(argv0);
+    }
+
+    return scan_token;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long starts = 64;
+    unsigned long sample = 0;
+    unsigned long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long top = 10;
+    char *input_filename = NULL;
+    int corpora_count = 0;
+    pthread_t *tids;
+    struct stat s;
+    int fd;
+
+    corpora = (struct corpus *) calloc(argc, sizeof(struct corpus));
+
+    /*
+     * parse the arguments to the program
+     */
+    for (int i = 1; i < argc; i++)
+    {
+	char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+	if (strcmp(argv[i], "-starts") == 0)
+	{
+	    starts = scan_number(argv[0], argv[i], value, UINT_MAX);
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-sample") == 0)
+	{
+	    sample = scan_number(argv[0], argv[i], value, ULONG_MAX);
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-threads") == 0)
+	{
+	    threads = scan_number(argv[0], argv[i], value, 1024);
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-top") == 0)
+	{
+	    top = scan_number(argv[0], argv[i], value, UINT_MAX);
+	    i++;
+	    continue;
+	}
+
+	if (*argv[i] == '-')
+	{
+	    fprintf(stderr, "%s: argument needs fixing: \"%s\"\n", argv[0], argv[i]);
+	    fail(argv[0]);
+	}
+
+	if (input_filename == NULL)
+	    input_filename = argv[i];
+	else
+	    corpora[corpora_count++].filename = argv[i];
+    }
+
+    if (input_filename == NULL || corpora_count == 0)
+	fail(argv[0]);
+
+    if (threads < 1)
+	threads = 1;
+
+    /*
+     * map the input and the corpus files
+     */
+    fd = open(input_filename, O_RDONLY);
+    if (fd == -1)
+    {
+	fprintf(stderr, "%s: cannot read the input file: %s\n",
+		argv[0], input_filename);
+	fail(argv[0]);
+    }
+    fstat(fd, &s);
+    size_input = s.st_size;
+    if (sample != 0 && sample < size_input)
+	size_input = sample;
+    if (size_input == 0)
+    {
+	fprintf(stderr, "%s: the input file is empty: %s\n",
+		argv[0], input_filename);
+	fail(argv[0]);
+    }
+    input = (unsigned char *) mmap(0, size_input, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (input == MAP_FAILED)
+    {
+	fprintf(stderr, "%s: cannot map the input file: %s\n",
+		argv[0], input_filename);
+	exit(1);
+    }
+
+    for (int i = 0; i < corpora_count; i++)
+    {
+	fd = open(corpora[i].filename, O_RDONLY);
+	if (fd == -1)
+	{
+	    fprintf(stderr, "%s: cannot read the corpus file: %s\n",
+		    argv[0], corpora[i].filename);
+	    fail(argv[0]);
+	}
+	fstat(fd, &s);
+	corpora[i].size = s.st_size;
+	if (corpora[i].size == 0)
+	{
+	    fprintf(stderr, "%s: the corpus file is empty: %s\n",
+		    argv[0], corpora[i].filename);
+	    fail(argv[0]);
+	}
+	corpora[i].data = (unsigned char *) mmap(0, corpora[i].size, PROT_READ,
+						 MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (corpora[i].data == MAP_FAILED)
+	{
+	    fprintf(stderr, "%s: cannot map the corpus file: %s\n",
+		    argv[0], corpora[i].filename);
+	    exit(1);
+	}
+    }
+
+    /*
+     * evenly spaced start offsets in each corpus - -start is limited to
+     *  UINT_MAX in emap
+     */
+    candidates = (struct candidate *) calloc(corpora_count * starts,
+					     sizeof(struct candidate));
+    if (candidates == NULL)
+    {
+	fprintf(stderr, "%s: out of memory\n", argv[0]);
+	exit(1);
+    }
+
+    candidates_count = 0;
+    for (int i = 0; i < corpora_count; i++)
+    {
+	off_t range = corpora[i].size;
+
+	if (range > UINT_MAX)
+	    range = UINT_MAX;
+
+	for (unsigned long j = 0; j < starts && j < range; j++)
+	{
+	    candidates[candidates_count].corpus = i;
+	    candidates[candidates_count].start = (off_t) (range * (double) j / starts);
+	    candidates_count++;
+	}
+    }
+
+    tids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+    if (tids == NULL)
+    {
+	fprintf(stderr, "%s: out of memory\n", argv[0]);
+	exit(1);
+    }
+    for (unsigned long i = 0; i < threads; i++)
+	if (pthread_create(&tids[i], NULL, worker, NULL) != 0)
+	{
+	    fprintf(stderr, "%s: cannot create the worker thread\n", argv[0]);
+	    exit(1);
+	}
+    for (unsigned long i = 0; i < threads; i++)
+	pthread_join(tids[i], NULL);
+
+    qsort(candidates, candidates_count, sizeof(struct candidate),
+	  candidate_compare);
+
+    fprintf(stdout, "%lu candidates: %d corpus files, %lu starts, %ld input bytes, %lu threads\n",
+	    candidates_count, corpora_count, starts, (long) size_input, threads);
+    for (unsigned long i = 0; i < top && i < candidates_count; i++)
+    {
+	struct candidate *candidate = &candidates[i];
+
+	if (candidate->failed || candidate->pruned)
+	    break;
+	fprintf(stdout, "-start %-10ld %s  output %ld  ratio %.3f  wraps %lu\n",
+		(long) candidate->start, corpora[candidate->corpus].filename,
+		(long) candidate->size_output,
+		(double) candidate->size_output / size_input,
+		candidate->wraps);
+    }
+
+    return 0;
+}
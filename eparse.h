@@ -0,0 +1,224 @@
+/*
+ * eparse.h: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  find runs of single byte distances in an emap output a block at a time
+ *
+ *  most bytes of an emap output are distances of 1 to 255.  A zero
+ *  starts a wrap or an escaped long distance.  eparse_block() finds the
+ *  first zero in EPARSE_BLOCK bytes with a vector compare and a movemask,
+ *  and adds up the distances before it with a vector prefix sum.  The
+ *  corpus offsets of the whole run are then known at once, so the corpus
+ *  reads for it do not wait on each other.
+ *
+ *  eparse_positions() turns the distances - runs, wraps and escaped long
+ *  distances - into corpus positions.
+ *
+ *  eparse_gather() makes the corpus reads for a batch of up to
+ *  EPARSE_BATCH positions, prefetching a set distance ahead.  On a corpus
+ *  much larger than the cache nearly every read is a cache or TLB miss,
+ *  and the prefetches let several of them be outstanding at once.
+ */
+#ifndef EPARSE_H
+#define EPARSE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "estats.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define EPARSE_BLOCK 32
+#define EPARSE_BATCH 256
+#define EPARSE_PREFETCH 0	// positions ahead - 0 for none
+
+#ifdef __SSE2__
+/*
+ * the running sums of 16 distances plus carry - returns the last sum in
+ *  every lane for the next 16.  Each sum fits in 16 bits.
+ */
+static inline __m128i
+eparse_sums16(__m128i v, __m128i carry, uint16_t *offsets)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+    __m128i last;
+
+    lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 2));
+    lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 4));
+    lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 8));
+    hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 2));
+    hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 4));
+    hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 8));
+
+    // the sum of the low eight carried into the high eight
+    lo = _mm_add_epi16(lo, carry);
+    last = _mm_shufflehi_epi16(lo, 0xff);
+    hi = _mm_add_epi16(hi, _mm_unpackhi_epi64(last, last));
+
+    _mm_storeu_si128((__m128i *) offsets, lo);
+    _mm_storeu_si128((__m128i *) (offsets + 8), hi);
+
+    last = _mm_shufflehi_epi16(hi, 0xff);
+    return _mm_unpackhi_epi64(last, last);
+}
+#endif
+
+/*
+ * the number of distances before the first zero in the EPARSE_BLOCK bytes
+ *  at in.  offsets[j] is set to the sum of the distances 0 through j, for
+ *  each j below that number.
+ */
+static inline int
+eparse_block(const unsigned char *in, uint16_t offsets[EPARSE_BLOCK])
+{
+#ifdef __SSE2__
+    __m128i zero = _mm_setzero_si128();
+    __m128i v0 = _mm_loadu_si128((const __m128i *) in);
+    __m128i v1 = _mm_loadu_si128((const __m128i *) (in + 16));
+    uint32_t zeros;
+
+    zeros = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v0, zero)) |
+	((uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v1, zero)) << 16);
+    if (zeros & 1)
+	return 0;
+
+    eparse_sums16(v1, eparse_sums16(v0, zero, offsets), offsets + 16);
+
+    return zeros == 0 ? EPARSE_BLOCK : __builtin_ctz(zeros);
+#else
+    uint16_t sum = 0;
+    int j;
+
+    for (j = 0; j < EPARSE_BLOCK && in[j] != 0; j++)
+    {
+	sum += in[j];
+	offsets[j] = sum;
+    }
+
+    return j;
+#endif
+}
+
+/*
+ * the corpus positions of the distances at in - returns how many were
+ *  found and sets *used to the input bytes they took.  *index moves to
+ *  the last position.
+ *
+ *  it stops short of max positions, of the last EPARSE_BLOCK bytes of
+ *  the input, of a wrap or escape which is not all in the input and of a
+ *  position past the end of the corpus.  The caller decodes those a byte
+ *  at a time.
+ */
+static inline size_t
+eparse_positions(const unsigned char *in, size_t size_in, size_t *used,
+		 off_t *index, off_t start, off_t size_corpus,
+		 off_t *positions, size_t max)
+{
+    uint16_t offsets[EPARSE_BLOCK];
+    off_t position = *index;
+    size_t p = 0;
+    size_t n = 0;
+
+    while (n + EPARSE_BLOCK <= max && p + EPARSE_BLOCK <= size_in)
+    {
+	int k = eparse_block(in + p, offsets);
+
+	if (k > 0)
+	{
+	    if (position + offsets[k - 1] >= size_corpus)
+		break;
+	    for (int j = 0; j < k; j++)
+		positions[n + j] = position + offsets[j];
+	    position += offsets[k - 1];
+	    p += k;
+	    n += k;
+	    ESTATS_ADD(input_bytes, k);
+	    ESTATS_ADD(corpus_bytes_scanned, offsets[k - 1]);
+	    ESTATS_ADD(output_bytes, k);
+	    continue;
+	}
+
+	// zero zero - wrap around the corpus
+	if (in[p + 1] == 0)
+	{
+	    position = start;
+	    p += 2;
+	    ESTATS_ADD(input_bytes, 2);
+	    ESTATS_ADD(wraps, 1);
+	    continue;
+	}
+
+	// zero, counts of 255, zero and the remainder
+	size_t q = p + 1;
+	off_t distance = 0;
+
+	while (q < size_in && in[q] != 0)
+	    distance += 255 * in[q++];
+	if (q + 1 >= size_in)
+	    break;
+	distance += in[q + 1];
+	if (position + distance >= size_corpus)
+	    break;
+	position += distance;
+	positions[n++] = position;
+	ESTATS_ADD(input_bytes, q + 2 - p);
+	ESTATS_ADD(long_distances, 1);
+	ESTATS_ADD(escape_bytes, q + 1 - p);
+	ESTATS_ADD(corpus_bytes_scanned, distance);
+	ESTATS_ADD(output_bytes, 1);
+	p = q + 2;
+    }
+
+    *index = position;
+    *used = p;
+    return n;
+}
+
+/*
+ * out[j] = corpus[positions[j]] for the n positions
+ */
+static inline void
+eparse_gather(const unsigned char *corpus, const off_t *positions, size_t n,
+	      unsigned char *out, size_t prefetch)
+{
+    size_t j = 0;
+
+    if (prefetch > 0)
+    {
+	for (size_t k = 0; k < prefetch && k < n; k++)
+	    __builtin_prefetch(corpus + positions[k]);
+	for (; j + prefetch < n; j++)
+	{
+	    __builtin_prefetch(corpus + positions[j + prefetch]);
+	    out[j] = corpus[positions[j]];
+	}
+    }
+    for (; j < n; j++)
+	out[j] = corpus[positions[j]];
+}
+
+#endif
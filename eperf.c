@@ -0,0 +1,164 @@
+/*
+ * eperf.c: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  hardware performance counters around benchmark kernels - see eperf.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdbool.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "eperf.h"
+
+static struct
+{
+    char *name;
+    unsigned int type;
+    unsigned long long config;
+} events[EPERF_EVENTS] =
+{
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "llc_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "dtlb_misses", PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_DTLB |
+      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+static double
+now_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * open each counter on its own - a group fails if any one event is
+ *  missing.  Only user space is counted so that the default
+ *  perf_event_paranoid setting allows the counters.  The counts of
+ *  threads started after the open are added in when the threads exit.
+ */
+void eperf_open(struct eperf *perf)
+{
+    struct perf_event_attr attr;
+
+    for (int i = 0; i < EPERF_EVENTS; i++)
+    {
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[i].type;
+	attr.config = events[i].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.inherit = 1;
+
+	perf->fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	perf->value[i] = 0;
+    }
+    perf->seconds = 0;
+}
+
+void eperf_start(struct eperf *perf)
+{
+    for (int i = 0; i < EPERF_EVENTS; i++)
+    {
+	if (perf->fd[i] == -1)
+	    continue;
+	ioctl(perf->fd[i], PERF_EVENT_IOC_RESET, 0);
+	ioctl(perf->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+    perf->started = now_seconds();
+}
+
+void eperf_stop(struct eperf *perf)
+{
+    perf->seconds = now_seconds() - perf->started;
+
+    for (int i = 0; i < EPERF_EVENTS; i++)
+    {
+	if (perf->fd[i] == -1)
+	    continue;
+	ioctl(perf->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+	if (read(perf->fd[i], &perf->value[i], sizeof(perf->value[i])) !=
+	    sizeof(perf->value[i]))
+	    perf->value[i] = 0;
+    }
+}
+
+void eperf_close(struct eperf *perf)
+{
+    for (int i = 0; i < EPERF_EVENTS; i++)
+    {
+	if (perf->fd[i] != -1)
+	    close(perf->fd[i]);
+	perf->fd[i] = -1;
+    }
+}
+
+bool eperf_available(struct eperf *perf, enum eperf_event event)
+{
+    return perf->fd[event] != -1;
+}
+
+/*
+ * one line per kernel: time, cycles per byte, IPC and the miss counts
+ */
+void eperf_report(FILE *fp, char *kernel, struct eperf *perf,
+		  unsigned long long bytes)
+{
+    fprintf(fp, "%-10s bytes %llu  seconds %.6f  MB/s %.1f", kernel, bytes,
+	    perf->seconds,
+	    perf->seconds > 0 ? bytes / perf->seconds / 1e6 : 0.0);
+
+    if (eperf_available(perf, EPERF_CYCLES) && bytes != 0)
+	fprintf(fp, "  cycles/byte %.2f",
+		(double) perf->value[EPERF_CYCLES] / bytes);
+    else
+	fprintf(fp, "  cycles/byte n/a");
+
+    if (eperf_available(perf, EPERF_CYCLES) &&
+	eperf_available(perf, EPERF_INSTRUCTIONS) &&
+	perf->value[EPERF_CYCLES] != 0)
+	fprintf(fp, "  IPC %.2f", (double) perf->value[EPERF_INSTRUCTIONS] /
+		perf->value[EPERF_CYCLES]);
+    else
+	fprintf(fp, "  IPC n/a");
+
+    for (int i = EPERF_LLC_MISSES; i < EPERF_EVENTS; i++)
+    {
+	if (eperf_available(perf, i))
+	    fprintf(fp, "  %s %llu", events[i].name, perf->value[i]);
+	else
+	    fprintf(fp, "  %s n/a", events[i].name);
+    }
+    fprintf(fp, "\n");
+}
@@ -0,0 +1,62 @@
+/*
+ * eperf.h: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  hardware performance counters around benchmark kernels
+ *
+ *  the counters are read with the Linux perf_event_open() system call.
+ *  Counters the kernel or the processor does not provide are reported
+ *  as unavailable and the kernels are still timed.
+ */
+#ifndef EPERF_H
+#define EPERF_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+enum eperf_event
+{
+    EPERF_CYCLES,
+    EPERF_INSTRUCTIONS,
+    EPERF_LLC_MISSES,
+    EPERF_DTLB_MISSES,
+    EPERF_BRANCH_MISSES,
+    EPERF_EVENTS
+};
+
+struct eperf
+{
+    int fd[EPERF_EVENTS];
+    unsigned long long value[EPERF_EVENTS];
+    double seconds;
+    double started;
+};
+
+extern void eperf_open(struct eperf *perf);
+extern void eperf_start(struct eperf *perf);
+extern void eperf_stop(struct eperf *perf);
+extern void eperf_close(struct eperf *perf);
+extern bool eperf_available(struct eperf *perf, enum eperf_event event);
+extern void eperf_report(FILE *fp, char *kernel, struct eperf *perf,
+			 unsigned long long bytes);
+
+#endif
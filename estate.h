@@ -0,0 +1,97 @@
+/*
+ * estate.h: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  the emap state file - where an encryption stopped
+ *
+ *  emap writes the plaintext offset, the ciphertext offset and the corpus
+ *  index reached at each -state checkpoint and at the exit, with a check
+ *  of the corpus and -start.  emap -resume continues an interrupted run
+ *  from the state and emap -append adds a new input to the end of the
+ *  ciphertext, which eunmap decodes as one stream.  The state is one
+ *  text record written to a temporary file and renamed, so a crash
+ *  leaves either the old state or the new one.
+ */
+#ifndef ESTATE_H
+#define ESTATE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#define ESTATE_FORMAT "%020llu %020llu %020llu %016llx\n"
+
+struct estate
+{
+    off_t plain;	// plaintext offset
+    off_t cipher;	// ciphertext offset
+    off_t index;	// corpus index
+    uint64_t check;	// efingerprint_check() of the corpus and -start
+};
+
+static inline bool
+estate_write(const char *filename, const struct estate *state)
+{
+    char name[4096];
+    FILE *fp;
+    bool ok;
+
+    snprintf(name, sizeof(name), "%s.tmp", filename);
+    fp = fopen(name, "w");
+    if (fp == NULL)
+	return false;
+
+    ok = fprintf(fp, ESTATE_FORMAT, (unsigned long long) state->plain,
+		 (unsigned long long) state->cipher,
+		 (unsigned long long) state->index,
+		 (unsigned long long) state->check) > 0 &&
+	fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = fclose(fp) == 0 && ok;
+
+    return ok && rename(name, filename) == 0;
+}
+
+static inline bool
+estate_read(const char *filename, struct estate *state)
+{
+    unsigned long long plain, cipher, index, check;
+    FILE *fp;
+    int n;
+
+    fp = fopen(filename, "r");
+    if (fp == NULL)
+	return false;
+    n = fscanf(fp, "%llu %llu %llu %llx", &plain, &cipher, &index, &check);
+    fclose(fp);
+    if (n != 4)
+	return false;
+
+    state->plain = plain;
+    state->cipher = cipher;
+    state->index = index;
+    state->check = check;
+    return true;
+}
+
+#endif
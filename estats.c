@@ -0,0 +1,182 @@
+/*
+ * estats.c: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  hot loop counters and the -stats report - see estats.h
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdbool.h>
+#include "estats.h"
+
+#ifdef ESTATS
+
+struct estats estats;	// the phases - and the counter totals at the report
+
+__thread struct estats *estats_thread;
+
+/*
+ * the counter blocks of all of the threads - a thread adds its block on
+ *  its first count.  The blocks outlive their threads so the counts of
+ *  joined threads are in the report.
+ */
+struct estats_list
+{
+    struct estats counters;
+    struct estats_list *next;
+};
+
+static struct estats_list *blocks;
+
+struct estats *
+estats_block(void)
+{
+    struct estats_list *block;
+
+    block = (struct estats_list *) calloc(1, sizeof(struct estats_list));
+    if (block == NULL)
+    {
+	fprintf(stderr, "out of memory for the statistics counters\n");
+	exit(1);
+    }
+
+    block->next = __atomic_load_n(&blocks, __ATOMIC_RELAXED);
+    while (__atomic_compare_exchange_n(&blocks, &block->next, block, false,
+				       __ATOMIC_RELEASE, __ATOMIC_RELAXED) == false)
+	;
+
+    estats_thread = &block->counters;
+    return estats_thread;
+}
+
+static char *phase_names[ESTATS_PHASES] = { "setup", "seek", "loop" };
+static enum estats_phase phase_current = ESTATS_SETUP;
+static double phase_started = -1;
+
+static double
+now_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * close the current phase and start the next one
+ */
+void estats_phase(enum estats_phase phase)
+{
+    double now = now_seconds();
+
+    if (phase_started >= 0)
+	estats.phase_seconds[phase_current] += now - phase_started;
+
+    phase_current = phase;
+    phase_started = now;
+}
+
+/*
+ * the counters of all of the threads added up
+ */
+static struct estats
+estats_total(void)
+{
+    struct estats total = estats;
+
+    for (struct estats_list *block = __atomic_load_n(&blocks, __ATOMIC_ACQUIRE);
+	 block != NULL; block = block->next)
+    {
+	total.input_bytes += block->counters.input_bytes;
+	total.output_bytes += block->counters.output_bytes;
+	total.corpus_bytes_scanned += block->counters.corpus_bytes_scanned;
+	total.same_byte_skips += block->counters.same_byte_skips;
+	total.long_distances += block->counters.long_distances;
+	total.escape_bytes += block->counters.escape_bytes;
+	total.wraps += block->counters.wraps;
+	total.tokens_generated += block->counters.tokens_generated;
+	total.byte_list_retries += block->counters.byte_list_retries;
+	total.uniform_retries += block->counters.uniform_retries;
+	total.skip_calls += block->counters.skip_calls;
+    }
+
+    return total;
+}
+
+void estats_report(FILE *fp, char *argv0, bool json)
+{
+    struct estats total = estats_total();
+    struct
+    {
+	char *name;
+	unsigned long long value;
+    } counters[] =
+    {
+	{ "input_bytes", total.input_bytes },
+	{ "output_bytes", total.output_bytes },
+	{ "corpus_bytes_scanned", total.corpus_bytes_scanned },
+	{ "same_byte_skips", total.same_byte_skips },
+	{ "long_distances", total.long_distances },
+	{ "escape_bytes", total.escape_bytes },
+	{ "wraps", total.wraps },
+	{ "tokens_generated", total.tokens_generated },
+	{ "byte_list_retries", total.byte_list_retries },
+	{ "uniform_retries", total.uniform_retries },
+	{ "skip_calls", total.skip_calls },
+    };
+    int ncounters = sizeof(counters) / sizeof(counters[0]);
+    double scanned_per_byte = 0;
+
+    estats_phase(phase_current);	// close the running phase
+
+    if (total.input_bytes != 0)
+	scanned_per_byte = (double) total.corpus_bytes_scanned /
+	    total.input_bytes;
+
+    if (json)
+    {
+	fprintf(fp, "{\"program\": \"%s\"", argv0);
+	for (int i = 0; i < ncounters; i++)
+	    fprintf(fp, ", \"%s\": %llu", counters[i].name, counters[i].value);
+	fprintf(fp, ", \"corpus_bytes_per_input_byte\": %.3f", scanned_per_byte);
+	for (int i = 0; i < ESTATS_PHASES; i++)
+	    fprintf(fp, ", \"%s_seconds\": %.6f",
+		    phase_names[i], estats.phase_seconds[i]);
+	fprintf(fp, "}\n");
+	return;
+    }
+
+    fprintf(fp, "%s: statistics\n", argv0);
+    for (int i = 0; i < ncounters; i++)
+	fprintf(fp, "  %-28s %llu\n", counters[i].name, counters[i].value);
+    fprintf(fp, "  %-28s %.3f\n", "corpus_bytes_per_input_byte",
+	    scanned_per_byte);
+    for (int i = 0; i < ESTATS_PHASES; i++)
+	fprintf(fp, "  %-20s seconds %.6f\n",
+		phase_names[i], estats.phase_seconds[i]);
+}
+
+#endif
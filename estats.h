@@ -0,0 +1,84 @@
+/*
+ * estats.h: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  hot loop counters for the -stats report
+ *
+ *  the counters are compiled in only when ESTATS is defined ("make stats").
+ *  Otherwise the macros are empty and the loops are unchanged.  Each
+ *  thread counts into its own block - the -pipeline producer and the
+ *  -batch workers run beside the loop - and the report adds them up.
+ */
+#ifndef ESTATS_H
+#define ESTATS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+enum estats_phase
+{
+    ESTATS_SETUP,	// argument parsing, opening and mapping files
+    ESTATS_SEEK,	// advancing to the -start offset
+    ESTATS_LOOP,	// the encrypt, decrypt or generate loop
+    ESTATS_PHASES
+};
+
+struct estats
+{
+    unsigned long long input_bytes;
+    unsigned long long output_bytes;
+    unsigned long long corpus_bytes_scanned;
+    unsigned long long same_byte_skips;	// match at distance equal to the byte
+    unsigned long long long_distances;	// distances greater than 255
+    unsigned long long escape_bytes;
+    unsigned long long wraps;
+    unsigned long long tokens_generated;
+    unsigned long long byte_list_retries;
+    unsigned long long uniform_retries;
+    unsigned long long skip_calls;	// random() calls from the skip options
+    double phase_seconds[ESTATS_PHASES];
+};
+
+#ifdef ESTATS
+
+extern __thread struct estats *estats_thread;
+
+extern struct estats *estats_block(void);
+extern void estats_phase(enum estats_phase phase);
+extern void estats_report(FILE *fp, char *argv0, bool json);
+
+#define ESTATS_ENABLED 1
+#define ESTATS_ADD(counter, n) \
+    ((estats_thread != NULL ? estats_thread : estats_block())->counter += (n))
+#define ESTATS_PHASE(phase) estats_phase(phase)
+#define ESTATS_REPORT(fp, argv0, json) estats_report(fp, argv0, json)
+
+#else
+
+#define ESTATS_ENABLED 0
+#define ESTATS_ADD(counter, n) do { } while (0)
+#define ESTATS_PHASE(phase) do { } while (0)
+#define ESTATS_REPORT(fp, argv0, json) ((void) (json))
+
+#endif
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * esync.h: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  sync points for decrypting a range of the plaintext
+ *
+ *  emap -sync N writes a sidecar file with a record every N plaintext
+ *  bytes: the plaintext offset, the ciphertext offset and the corpus index
+ *  before that byte is mapped.  The first record is at plaintext offset 0
+ *  so its corpus index is the -start value.  The records are fixed width
+ *  text so eunmap -range can binary search the file without reading it.
+ */
+#ifndef ESYNC_H
+#define ESYNC_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define ESYNC_FORMAT "%020llu %020llu %020llu\n"
+#define ESYNC_RECORD_SIZE 63
+
+struct esync
+{
+    off_t plain;	// plaintext offset
+    off_t cipher;	// ciphertext offset
+    off_t index;	// corpus index
+};
+
+static inline bool
+esync_write(FILE *fp, off_t plain, off_t cipher, off_t index)
+{
+    return fprintf(fp, ESYNC_FORMAT, (unsigned long long) plain,
+		   (unsigned long long) cipher,
+		   (unsigned long long) index) == ESYNC_RECORD_SIZE;
+}
+
+static inline bool
+esync_read(FILE *fp, off_t record, struct esync *sync)
+{
+    unsigned long long plain, cipher, index;
+
+    if (fseeko(fp, record * ESYNC_RECORD_SIZE, SEEK_SET) != 0 ||
+	fscanf(fp, "%llu %llu %llu", &plain, &cipher, &index) != 3)
+	return false;
+
+    sync->plain = plain;
+    sync->cipher = cipher;
+    sync->index = index;
+    return true;
+}
+
+/*
+ * the last record at or before the plaintext offset
+ */
+static inline bool
+esync_find(FILE *fp, off_t plain, struct esync *sync)
+{
+    off_t low = 0;
+    off_t high;
+
+    if (fseeko(fp, 0, SEEK_END) != 0)
+	return false;
+    high = ftello(fp) / ESYNC_RECORD_SIZE - 1;
+    if (high < 0 || esync_read(fp, 0, sync) == false || sync->plain != 0)
+	return false;
+
+    while (low < high)
+    {
+	off_t middle = low + (high - low + 1) / 2;
+	struct esync test;
+
+	if (esync_read(fp, middle, &test) == false)
+	    return false;
+	if (test.plain <= plain)
+	{
+	    low = middle;
+	    *sync = test;
+	}
+	else
+	    high = middle - 1;
+    }
+
+    return true;
+}
+
+#endif
@@ -24,16 +24,39 @@ SOFTWARE.
 
  *  talley byte code values from a file - all: corpus file or regular input
  */
-#define _POSIX_C_SOURCE 1
+#define _POSIX_C_SOURCE 200809L
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <math.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "ebulk.h"
+#include "eweights.h"
+#include "emap_kernel.h"
+
+/*
+ * weighted tally files hold about this many bytes in all
+ */
+#define WEIGHTS_TOTAL 4096
+
+/*
+ * -advise reads the input in blocks spread over the file and models an
+ *  ecorpus corpus in memory
+ */
+#define ADVISE_BLOCK 65536
+#define ADVISE_SAMPLE (16 * 1024 * 1024)
+#define ADVISE_MODEL (16 * 1024 * 1024)
 
 void
 fail(char *argv0)
@@ -46,9 +69,791 @@ fail(char *argv0)
     fprintf(stderr, "  %s: use \"-stop_on_256\" to exit when 256 values are found\n", argv0);
     fprintf(stderr, "  %s: use \"-print_bytes\" to print the bytes found\n", argv0);
     fprintf(stderr, "  %s:  \"-print_bytes\" can be used for creating byte lists for ecorpus\n", argv0);
+    fprintf(stderr, "  %s: use \"-print_weights\" to print the bytes found repeated by frequency\n", argv0);
+    fprintf(stderr, "  %s:  \"-print_weights\" can be used for ecorpus -weighted byte lists\n", argv0);
+    fprintf(stderr, "  %s: use \"-gaps\" to print the gaps between each byte value and the predicted output size\n", argv0);
+    fprintf(stderr, "  %s:  \"-byte_list file\" with \"-gaps\" weights the prediction by the bytes in the file\n", argv0);
+    fprintf(stderr, "  %s -scan directory [ OPTIONS ]\n", argv0);
+    fprintf(stderr, "  %s:  \"-scan\" lists the files which could be corpus files - best first\n", argv0);
+    fprintf(stderr, "  %s: use \"-byte_list file\" to need only the bytes in the file - not all 256\n", argv0);
+    fprintf(stderr, "  %s: use \"-candidates file\" to write the list to the file\n", argv0);
+    fprintf(stderr, "  %s: use \"-threads N\" to set the number of -scan worker threads\n", argv0);
+    fprintf(stderr, "  %s:  \"-stop_on_256\" with \"-scan\" lists the files without ranking them\n", argv0);
+    fprintf(stderr, "  %s -advise inputfilename [ OPTIONS ]\n", argv0);
+    fprintf(stderr, "  %s:  \"-advise\" predicts the corpus size, output size and encode time for the input\n", argv0);
+    fprintf(stderr, "  %s: use \"-corpus file\" to predict for an existing corpus file\n", argv0);
+    fprintf(stderr, "  %s: use \"-byte_list file\", \"-weighted\" and \"-uniform\" to predict for an ecorpus corpus\n", argv0);
+    fprintf(stderr, "  %s: use \"-sample N\" to read N bytes of the input - %d\n", argv0, ADVISE_SAMPLE);
     exit(1);
 }
 
+/*
+ * count the bytes in a byte list file - all 256 once when there is none
+ */
+static void
+read_byte_list(char *argv0, char *byte_list, unsigned long counts[256])
+{
+    FILE *fp;
+    int c;
+
+    for (int i = 0; i < 256; i++)
+	counts[i] = (byte_list == NULL);
+    if (byte_list == NULL)
+	return;
+
+    fp = fopen(byte_list, "r");
+    if (fp == NULL)
+    {
+	fprintf(stderr, "%s: cannot open the byte list file: %s\n",
+		argv0, byte_list);
+	exit(1);
+    }
+    while ((c = fgetc(fp)) != EOF)
+	counts[c & 0377]++;
+    fclose(fp);
+}
+
+/*
+ * scan a directory tree for files which could be corpus files
+ *
+ *  a candidate holds every needed byte value.  Candidates are ranked by
+ *  the largest gap between occurrences of a needed byte - which bounds
+ *  the distances emap writes - and then by the uniformity of the byte
+ *  counts: the standard deviation over the mean.  With -stop_on_256 each
+ *  file is read only until all of the needed bytes are found.
+ */
+struct scan_file
+{
+    char *name;
+    off_t size;
+    off_t max_gap;
+    double uniformity;
+    bool candidate;
+};
+
+static struct scan_file *scan_files = NULL;
+static unsigned long scan_count = 0;
+static unsigned long scan_next = 0;
+static bool scan_needed[256];
+static int scan_needed_count = 0;
+static bool scan_early_exit = false;
+static char *scan_argv0;
+
+static void
+scan_add(char *filename, off_t size)
+{
+    if (scan_count % 1024 == 0)
+    {
+	scan_files = realloc(scan_files,
+			     (scan_count + 1024) * sizeof(struct scan_file));
+	if (scan_files == NULL)
+	{
+	    fprintf(stderr, "%s: out of memory for the -scan list\n",
+		    scan_argv0);
+	    exit(1);
+	}
+    }
+
+    memset(&scan_files[scan_count], 0, sizeof(struct scan_file));
+    scan_files[scan_count].name = strdup(filename);
+    scan_files[scan_count].size = size;
+    scan_count++;
+}
+
+/*
+ * regular files under the directory - symbolic links are not followed
+ */
+static void
+scan_add_directory(char *directory)
+{
+    DIR *dir;
+    struct dirent *entry;
+    struct stat s;
+    char path[4096];
+
+    dir = opendir(directory);
+    if (dir == NULL)
+    {
+	fprintf(stderr, "%s: cannot read the directory: %s\n",
+		scan_argv0, directory);
+	return;
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+	if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+	    continue;
+
+	snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+	if (lstat(path, &s) != 0)
+	    continue;
+
+	if (S_ISDIR(s.st_mode))
+	    scan_add_directory(path);
+	else if (S_ISREG(s.st_mode) && s.st_size > 0)
+	    scan_add(path, s.st_size);
+    }
+
+    closedir(dir);
+}
+
+static void
+scan_file_run(struct scan_file *file)
+{
+    unsigned char *data;
+    unsigned long counts[256];
+    off_t last[256];
+    off_t max_gap[256];
+    int fd;
+
+    fd = open(file->name, O_RDONLY);
+    if (fd == -1)
+	return;
+    data = (unsigned char *) mmap(0, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+	return;
+    posix_madvise(data, file->size, POSIX_MADV_SEQUENTIAL);
+
+    for (int i = 0; i < 256; i++)
+    {
+	counts[i] = 0;
+	last[i] = -1;
+	max_gap[i] = 0;
+    }
+
+    if (scan_early_exit)
+    {
+	int found = 0;
+
+	for (off_t i = 0; i < file->size && found < scan_needed_count; i++)
+	    if (scan_needed[data[i]] && counts[data[i]]++ == 0)
+		found++;
+
+	file->candidate = (found == scan_needed_count);
+	munmap(data, file->size);
+	return;
+    }
+
+    for (off_t i = 0; i < file->size; i++)
+    {
+	unsigned char b = data[i];
+
+	if (i - last[b] > max_gap[b])
+	    max_gap[b] = i - last[b];
+	last[b] = i;
+	counts[b]++;
+    }
+    munmap(data, file->size);
+
+    /*
+     * the gap from the last occurrence to the end of the file counts too
+     */
+    file->candidate = true;
+    {
+	double mean = 0;
+	double sum_of_squares = 0;
+
+	for (int i = 0; i < 256; i++)
+	{
+	    if (scan_needed[i] == false)
+		continue;
+	    if (counts[i] == 0)
+	    {
+		file->candidate = false;
+		return;
+	    }
+	    if (file->size - last[i] > max_gap[i])
+		max_gap[i] = file->size - last[i];
+	    if (max_gap[i] > file->max_gap)
+		file->max_gap = max_gap[i];
+	    mean += counts[i];
+	}
+
+	mean = mean / scan_needed_count;
+	for (int i = 0; i < 256; i++)
+	    if (scan_needed[i])
+		sum_of_squares += (counts[i] - mean) * (counts[i] - mean);
+	file->uniformity = sqrt(sum_of_squares / scan_needed_count) / mean;
+    }
+}
+
+static void *
+scan_worker(void *arg)
+{
+    while (true)
+    {
+	unsigned long next = __atomic_fetch_add(&scan_next, 1, __ATOMIC_RELAXED);
+
+	if (next >= scan_count)
+	    break;
+	scan_file_run(&scan_files[next]);
+    }
+
+    return NULL;
+}
+
+static int
+scan_compare(const void *a, const void *b)
+{
+    const struct scan_file *fa = a;
+    const struct scan_file *fb = b;
+
+    if (fa->candidate != fb->candidate)
+	return fa->candidate ? -1 : 1;
+    if (fa->max_gap != fb->max_gap)
+	return fa->max_gap < fb->max_gap ? -1 : 1;
+    if (fa->uniformity != fb->uniformity)
+	return fa->uniformity < fb->uniformity ? -1 : 1;
+    return strcmp(fa->name, fb->name);
+}
+
+/*
+ * write the candidates - one per line:
+ *    max-gap uniformity size filename
+ *  or with -stop_on_256 just the filenames
+ */
+static int
+scan(char *argv0, char *directory, char *byte_list, char *candidates,
+     unsigned long threads, bool early_exit)
+{
+    unsigned long list_counts[256];
+    unsigned long found = 0;
+    pthread_t *tids;
+    FILE *fp;
+
+    scan_argv0 = argv0;
+    scan_early_exit = early_exit;
+
+    read_byte_list(argv0, byte_list, list_counts);
+    for (int i = 0; i < 256; i++)
+    {
+	scan_needed[i] = (list_counts[i] != 0);
+	if (scan_needed[i])
+	    scan_needed_count++;
+    }
+    if (scan_needed_count == 0)
+    {
+	fprintf(stderr, "%s: the byte list file is empty: %s\n", argv0, byte_list);
+	exit(1);
+    }
+
+    scan_add_directory(directory);
+
+    tids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+    for (unsigned long i = 0; i < threads; i++)
+	if (pthread_create(&tids[i], NULL, scan_worker, NULL) != 0)
+	{
+	    fprintf(stderr, "%s: cannot create the scan thread\n", argv0);
+	    exit(1);
+	}
+    for (unsigned long i = 0; i < threads; i++)
+	pthread_join(tids[i], NULL);
+    free(tids);
+
+    if (early_exit == false)
+	qsort(scan_files, scan_count, sizeof(struct scan_file), scan_compare);
+
+    if (candidates == NULL)
+	fp = stdout;
+    else
+	fp = fopen(candidates, "w");
+    if (fp == NULL)
+    {
+	fprintf(stderr, "%s: cannot create the candidates file: %s\n",
+		argv0, candidates);
+	exit(1);
+    }
+
+    for (unsigned long i = 0; i < scan_count; i++)
+    {
+	struct scan_file *file = &scan_files[i];
+
+	if (file->candidate == false)
+	    continue;
+	if (early_exit)
+	    fprintf(fp, "%s\n", file->name);
+	else
+	    fprintf(fp, "%ld %.4f %ld %s\n", (long) file->max_gap,
+		    file->uniformity, (long) file->size, file->name);
+	found++;
+    }
+    if (fp != stdout)
+	fclose(fp);
+
+    fprintf(stderr, "%s: %lu of %lu files hold all %d needed byte values\n",
+	    argv0, found, scan_count, scan_needed_count);
+
+    return 0;
+}
+
+/*
+ * gap analysis - the distances between occurrences of each byte value
+ *
+ *  a gap is the distance from one occurrence of a byte to the next; the
+ *  gap from the last occurrence wraps around to the first so the gaps of
+ *  a byte add up to the file size.  emap maps a byte at a position inside
+ *  a gap to the distance to the end of the gap, so over all positions the
+ *  encoded length of a byte is the sum over its gaps of the lengths of
+ *  the distances 1 to gap - divided by the file size.  As the gaps add up
+ *  to the file size only the bytes over one per distance are summed in
+ *  the loop.  Passing over a match at a distance equal to the byte value
+ *  is not counted.
+ *
+ *  the file is split into one chunk per thread and the chunks are joined
+ *  in order.
+ */
+#define GAPS_BUCKETS 48		// gaps of 2^k to 2^(k+1) - 1
+
+struct gaps_chunk
+{
+    unsigned char *data;
+    off_t begin;
+    off_t end;
+    off_t first[256];		// -1 when the byte is not in the chunk
+    off_t last[256];
+    unsigned long count[256];
+    off_t max_gap[256];
+    unsigned long long length_extra[256];	// over one byte per distance
+    unsigned long histogram[256][GAPS_BUCKETS];
+};
+
+/*
+ * the output bytes for all of the distances 1 to gap - the lengths from
+ *  emap_distance_length() are constant over runs of 255 * 255 distances
+ */
+static unsigned long long
+gaps_length_sum(off_t gap)
+{
+    unsigned long long sum = gap;
+    off_t low = 256;
+
+    for (off_t k = 1; low <= gap; k++)
+    {
+	off_t high = 65025 * k + 255;
+
+	if (high > gap)
+	    high = gap;
+	sum += (high - low + 1) * (2 + k);
+	low = high + 1;
+    }
+
+    return sum;
+}
+
+static inline void
+gaps_add(struct gaps_chunk *chunk, unsigned char b, off_t gap)
+{
+    int bucket = 63 - __builtin_clzll(gap);
+
+    if (gap > chunk->max_gap[b])
+	chunk->max_gap[b] = gap;
+    if (gap > 255)
+	chunk->length_extra[b] += gaps_length_sum(gap) - gap;
+    chunk->histogram[b][bucket < GAPS_BUCKETS ? bucket : GAPS_BUCKETS - 1]++;
+}
+
+static void *
+gaps_worker(void *arg)
+{
+    struct gaps_chunk *chunk = (struct gaps_chunk *) arg;
+    off_t last[256];
+
+    for (int i = 0; i < 256; i++)
+    {
+	chunk->first[i] = -1;
+	last[i] = -1;
+    }
+
+    for (off_t i = chunk->begin; i < chunk->end; i++)
+    {
+	unsigned char b = chunk->data[i];
+
+	if (last[b] == -1)
+	    chunk->first[b] = i;
+	else
+	    gaps_add(chunk, b, i - last[b]);
+	last[b] = i;
+	chunk->count[b]++;
+    }
+
+    memcpy(chunk->last, last, sizeof(last));
+    return NULL;
+}
+
+/*
+ * map a file to be read - the size is returned in *size
+ */
+static unsigned char *
+map_file(char *argv0, char *filename, off_t *size)
+{
+    unsigned char *data;
+    struct stat s;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd == -1 || fstat(fd, &s) != 0)
+    {
+	fprintf(stderr, "%s: cannot open the file: %s\n", argv0, filename);
+	exit(1);
+    }
+    *size = s.st_size;
+    data = (*size == 0) ? MAP_FAILED :
+	(unsigned char *) mmap(0, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+	fprintf(stderr, "%s: cannot map the file: %s\n", argv0, filename);
+	exit(1);
+    }
+
+    return data;
+}
+
+static int
+gaps(char *argv0, char *filename, char *byte_list, unsigned long threads)
+{
+    struct gaps_chunk *chunks;
+    struct gaps_chunk *total;
+    unsigned long list_counts[256];
+    unsigned long list_total = 0;
+    unsigned char *data;
+    pthread_t *tids;
+    off_t size;
+    off_t max_gap = 0;
+    double predicted = 0;
+    int missing = 0;
+
+    read_byte_list(argv0, byte_list, list_counts);
+    for (int i = 0; i < 256; i++)
+	list_total += list_counts[i];
+    if (list_total == 0)
+    {
+	fprintf(stderr, "%s: the byte list file is empty: %s\n", argv0, byte_list);
+	exit(1);
+    }
+
+    data = map_file(argv0, filename, &size);
+
+    if (threads > size / 65536 + 1)
+	threads = size / 65536 + 1;
+    chunks = (struct gaps_chunk *) calloc(threads + 1, sizeof(struct gaps_chunk));
+    tids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+    if (chunks == NULL || tids == NULL)
+    {
+	fprintf(stderr, "%s: out of memory for the gaps\n", argv0);
+	exit(1);
+    }
+
+    for (unsigned long i = 0; i < threads; i++)
+    {
+	chunks[i].data = data;
+	chunks[i].begin = size / threads * i;
+	chunks[i].end = (i == threads - 1) ? size : size / threads * (i + 1);
+	if (pthread_create(&tids[i], NULL, gaps_worker, &chunks[i]) != 0)
+	{
+	    fprintf(stderr, "%s: cannot create the gaps thread\n", argv0);
+	    exit(1);
+	}
+    }
+    for (unsigned long i = 0; i < threads; i++)
+	pthread_join(tids[i], NULL);
+
+    /*
+     * join the chunks in order - the gaps across the chunk boundaries and
+     *  the one wrapping around the end are added here
+     */
+    total = &chunks[threads];
+    for (int b = 0; b < 256; b++)
+    {
+	total->first[b] = -1;
+	total->last[b] = -1;
+    }
+    for (unsigned long i = 0; i < threads; i++)
+    {
+	struct gaps_chunk *chunk = &chunks[i];
+
+	for (int b = 0; b < 256; b++)
+	{
+	    if (chunk->count[b] == 0)
+		continue;
+
+	    if (total->last[b] == -1)
+		total->first[b] = chunk->first[b];
+	    else
+		gaps_add(total, b, chunk->first[b] - total->last[b]);
+	    total->last[b] = chunk->last[b];
+	    total->count[b] += chunk->count[b];
+	    if (chunk->max_gap[b] > total->max_gap[b])
+		total->max_gap[b] = chunk->max_gap[b];
+	    total->length_extra[b] += chunk->length_extra[b];
+	    for (int k = 0; k < GAPS_BUCKETS; k++)
+		total->histogram[b][k] += chunk->histogram[b][k];
+	}
+    }
+    for (int b = 0; b < 256; b++)
+	if (total->count[b] != 0)
+	    gaps_add(total, b, size - total->last[b] + total->first[b]);
+
+    munmap(data, size);
+
+    /*
+     * a line per byte value:
+     *    byte count max-gap mean-gap bytes-per-byte histogram...
+     */
+    fprintf(stdout, "byte count max_gap mean_gap bytes_per_byte histogram(2^k)\n");
+    for (int b = 0; b < 256; b++)
+    {
+	int top = GAPS_BUCKETS - 1;
+	double length;
+
+	if (total->count[b] == 0)
+	{
+	    if (list_counts[b] != 0)
+	    {
+		fprintf(stdout, "%d 0 missing\n", b);
+		missing++;
+	    }
+	    continue;
+	}
+
+	if (total->max_gap[b] > max_gap && list_counts[b] != 0)
+	    max_gap = total->max_gap[b];
+	length = (double) (size + total->length_extra[b]) / size;
+	predicted += list_counts[b] * length;
+
+	fprintf(stdout, "%d %lu %ld %.1f %.4f", b, total->count[b],
+		(long) total->max_gap[b], (double) size / total->count[b],
+		length);
+	while (top > 0 && total->histogram[b][top] == 0)
+	    top--;
+	for (int k = 0; k <= top; k++)
+	    fprintf(stdout, " %lu", total->histogram[b][k]);
+	fprintf(stdout, "\n");
+    }
+
+    fprintf(stdout, "largest gap: %ld\n", (long) max_gap);
+    if (missing != 0)
+	fprintf(stdout, "missing byte values: %d - the corpus will wrap and fail\n",
+		missing);
+    else
+	fprintf(stdout, "predicted output bytes per input byte: %.4f\n",
+		predicted / list_total);
+
+    free(chunks);
+    free(tids);
+    return missing == 0 ? 0 : 1;
+}
+
+/*
+ * corpus sizing - predict the corpus an input needs before running emap
+ *
+ *  blocks of the input spread over the file are mapped with emap_search()
+ *  as emap maps them, with the corpus wrapping around as if it went on.
+ *  The corpus used, the output bytes and the time per input byte of the
+ *  sample are scaled to the whole input.  The distances are close to
+ *  independent, so the corpus used by the input is about normal: the
+ *  mean and three standard deviations is the smallest corpus which
+ *  should not wrap.
+ *
+ *  the corpus is a corpus file or a model of an ecorpus corpus made in
+ *  memory with the same -byte_list, -weighted and -uniform.  The skip
+ *  options draw more random numbers but do not change the byte
+ *  frequencies, so they do not change the prediction.  Natural corpus
+ *  files are not random - the bytes of a text cluster together - so a
+ *  model from their byte counts alone would be far off.
+ */
+static unsigned char *
+advise_model(char *argv0, char *byte_list, bool weighted, bool uniform,
+	     off_t size, int *values)
+{
+    unsigned long counts[256];
+    unsigned char table[EWEIGHTS_BLOCK + 256];
+    int weights[256];
+    int block[256] = { 0 };
+    unsigned int table_size = 0;
+    unsigned int block_size = 0;
+    uint64_t x = 4787;
+    unsigned char *data;
+
+    read_byte_list(argv0, byte_list, counts);
+
+    /*
+     * the byte weights as ecorpus makes them
+     */
+    *values = 0;
+    for (int i = 0; i < 256; i++)
+    {
+	weights[i] = counts[i] > INT_MAX ? INT_MAX : counts[i];
+	if (weights[i] != 0)
+	    (*values)++;
+    }
+    if (*values == 0)
+    {
+	fprintf(stderr, "%s: the byte list file is empty: %s\n", argv0, byte_list);
+	exit(1);
+    }
+    if (weighted)
+	table_size = eweights_build(weights, table);
+    else
+	for (int i = 0; i < 256; i++)
+	{
+	    weights[i] = (weights[i] != 0);
+	    if (weights[i])
+		table[table_size++] = i;
+	}
+
+    data = (unsigned char *) malloc(size);
+    if (data == NULL)
+    {
+	fprintf(stderr, "%s: out of memory for the model corpus\n", argv0);
+	exit(1);
+    }
+
+    /*
+     * -uniform blocks hold each byte value its weight times - a byte
+     *  drawn once its block is full is drawn again, as in ecorpus
+     */
+    for (off_t i = 0; i < size; )
+    {
+	unsigned char token = table[ebulk_splitmix(&x) % table_size];
+
+	if (uniform)
+	{
+	    if (block[token] >= weights[token])
+		continue;
+
+	    block[token]++;
+	    if (++block_size == table_size)
+	    {
+		memset(block, 0, sizeof(block));
+		block_size = 0;
+	    }
+	}
+	data[i++] = token;
+    }
+
+    return data;
+}
+
+static int
+advise(char *argv0, char *filename, char *corpus, char *byte_list,
+       bool weighted, bool uniform, unsigned long sample)
+{
+    unsigned char *input;
+    unsigned char *data;
+    off_t size_input;
+    off_t size_corpus;
+    off_t blocks;
+    off_t stride;
+    off_t index_corpus = 0;
+    bool missing[256] = { false };
+    int missing_count = 0;
+    int values = 0;
+    unsigned long sampled = 0;
+    double used = 0;
+    double squares = 0;
+    double length = 0;
+    double mean, deviation, scale, seconds;
+    struct timespec begin, end;
+
+    input = map_file(argv0, filename, &size_input);
+    if (corpus != NULL)
+	data = map_file(argv0, corpus, &size_corpus);
+    else
+    {
+	size_corpus = ADVISE_MODEL;
+	data = advise_model(argv0, byte_list, weighted, uniform, size_corpus,
+			    &values);
+    }
+
+    blocks = (size_input + ADVISE_BLOCK - 1) / ADVISE_BLOCK;
+    if (sample < ADVISE_BLOCK)
+	sample = ADVISE_BLOCK;
+    if (blocks > sample / ADVISE_BLOCK)
+	blocks = sample / ADVISE_BLOCK;
+    stride = size_input / blocks;
+    if (stride < ADVISE_BLOCK)
+	stride = ADVISE_BLOCK;
+
+    /*
+     * map the sample - a wrap adds the rest of the corpus to the distance
+     */
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (off_t k = 0; k < blocks; k++)
+    {
+	off_t end_block = k * stride + ADVISE_BLOCK;
+
+	if (end_block > size_input)
+	    end_block = size_input;
+	for (off_t i = k * stride; i < end_block; i++)
+	{
+	    unsigned char c = input[i];
+	    off_t distance = emap_search(data, size_corpus, index_corpus, c);
+
+	    if (distance == -1)
+	    {
+		off_t rest = size_corpus - 1 - index_corpus;
+
+		distance = emap_search(data, size_corpus, 0, c);
+		if (distance == -1)
+		{
+		    if (missing[c] == false)
+			missing_count++;
+		    missing[c] = true;
+		    continue;
+		}
+		index_corpus = distance;
+		distance += rest;
+	    }
+	    else
+		index_corpus += distance;
+
+	    used += distance;
+	    squares += (double) distance * distance;
+	    length += emap_distance_length(distance);
+	    sampled++;
+	}
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+
+    fprintf(stdout, "input: %s %ld bytes\n", filename, (long) size_input);
+    if (corpus != NULL)
+	fprintf(stdout, "corpus: %s %ld bytes\n", corpus, (long) size_corpus);
+    else
+	fprintf(stdout, "corpus: ecorpus model - %d byte values%s%s\n", values,
+		weighted ? " -weighted" : "", uniform ? " -uniform" : "");
+
+    if (missing_count != 0)
+    {
+	for (int c = 0; c < 256; c++)
+	    if (missing[c])
+		fprintf(stdout, "byte %d is not in the corpus\n", c);
+	fprintf(stdout, "missing byte values: %d - emap will bail\n",
+		missing_count);
+	return 1;
+    }
+
+    mean = used / sampled;
+    deviation = sqrt(squares / sampled - mean * mean);
+    scale = (double) size_input / sampled;
+    fprintf(stdout, "sampled input bytes: %lu\n", sampled);
+    fprintf(stdout, "corpus bytes per input byte: %.2f\n", mean);
+    fprintf(stdout, "output bytes per input byte: %.4f\n", length / sampled);
+    fprintf(stdout, "corpus bytes used: %.0f\n", used * scale);
+    fprintf(stdout, "minimum corpus_size: %.0f - three standard deviations more\n",
+	    used * scale + 3 * deviation * sqrt(size_input));
+    fprintf(stdout, "expected output size: %.0f\n", length * scale);
+    fprintf(stdout, "expected encode seconds: %.3f - the corpus search only\n",
+	    seconds * scale);
+    if (corpus != NULL)
+	fprintf(stdout, "expected wraps of this corpus: %.2f\n",
+		used * scale / size_corpus);
+
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     FILE *fp_bytes;
@@ -63,11 +868,23 @@ int main(int argc, char **argv)
     bool print_outliers = false;
     bool stop_on_256 = false;
     bool print_bytes = false;
+    bool print_weights = false;
     unsigned long start = 0;
 
     char *argv1 = NULL;
     int total_256 = 0;
 
+    char *scan_directory = NULL;
+    char *byte_list = NULL;
+    char *candidates = NULL;
+    bool gaps_analysis = false;
+    bool advising = false;
+    bool weighted = false;
+    bool uniform = false;
+    char *corpus = NULL;
+    unsigned long sample = ADVISE_SAMPLE;
+    unsigned long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
     /*
      * parse the arguments to the program
      */
@@ -89,12 +906,112 @@ int main(int argc, char **argv)
 	    continue;
 	}
 
+	if (strcmp(argv[i], "-print_weights") == 0)
+	{
+	    print_bytes = true;
+	    print_weights = true;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-gaps") == 0)
+	{
+	    gaps_analysis = true;
+	    continue;
+	}
+
 	if (strcmp(argv[i], "-stop_on_256") == 0)
 	{
 	    stop_on_256 = true;
 	    continue;
 	}
 
+	if (strcmp(argv[i], "-advise") == 0)
+	{
+	    advising = true;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-weighted") == 0)
+	{
+	    weighted = true;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-uniform") == 0)
+	{
+	    uniform = true;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-scan") == 0 || strcmp(argv[i], "-byte_list") == 0 ||
+	    strcmp(argv[i], "-candidates") == 0 || strcmp(argv[i], "-corpus") == 0)
+	{
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no %s value given\n", argv[0], argv[i]);
+		fail(argv[0]);
+	    }
+
+	    if (strcmp(argv[i], "-scan") == 0)
+		scan_directory = argv[i + 1];
+	    else if (strcmp(argv[i], "-byte_list") == 0)
+		byte_list = argv[i + 1];
+	    else if (strcmp(argv[i], "-corpus") == 0)
+		corpus = argv[i + 1];
+	    else
+		candidates = argv[i + 1];
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-threads") == 0)
+	{
+	    unsigned int rvalue;
+	    unsigned long scan_token;
+
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -threads value given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    rvalue = sscanf(argv[i + 1], "%lu", &scan_token);
+	    if (rvalue == 0 || rvalue == EOF || scan_token == 0 || scan_token > 1024)
+	    {
+		fprintf(stderr, "%s: -threads value (%s) is not an integer in the range of 1 to 1024\n",
+			argv[0], argv[i + 1]);
+		fail(argv[0]);
+	    }
+
+	    threads = scan_token;
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-sample") == 0)
+	{
+	    unsigned int rvalue;
+	    unsigned long scan_token;
+
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -sample value given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    rvalue = sscanf(argv[i + 1], "%lu", &scan_token);
+	    if (rvalue == 0 || rvalue == EOF || scan_token == 0)
+	    {
+		fprintf(stderr, "%s: -sample value (%s) is not an integer greater than 0\n",
+			argv[0], argv[i + 1]);
+		fail(argv[0]);
+	    }
+
+	    sample = scan_token;
+	    i++;
+	    continue;
+	}
+
 	if (strcmp(argv[i], "-start") == 0)
 	{
 	    unsigned int rvalue;
@@ -127,6 +1044,43 @@ int main(int argc, char **argv)
 	argv1 = argv[i];
     }
 
+    if (scan_directory != NULL)
+    {
+	if (argv1 != NULL)
+	    fail(argv[0]);
+	if (threads < 1)
+	    threads = 1;
+	return scan(argv[0], scan_directory, byte_list, candidates, threads,
+		    stop_on_256);
+    }
+
+    if (argv1 == NULL)
+	fail(argv[0]);
+
+    if (advising)
+    {
+	if (corpus != NULL && (byte_list != NULL || weighted || uniform))
+	{
+	    fprintf(stderr, "%s: -corpus cannot be used with -byte_list, -weighted or -uniform\n",
+		    argv[0]);
+	    fail(argv[0]);
+	}
+	if (weighted && byte_list == NULL)
+	{
+	    fprintf(stderr, "%s: -weighted needs a -byte_list file\n", argv[0]);
+	    fail(argv[0]);
+	}
+	return advise(argv[0], argv1, corpus, byte_list, weighted, uniform,
+		      sample);
+    }
+
+    if (gaps_analysis)
+    {
+	if (threads < 1)
+	    threads = 1;
+	return gaps(argv[0], argv1, byte_list, threads);
+    }
+
     /*
      * total the bytes in the file
      */
@@ -184,6 +1138,7 @@ int main(int argc, char **argv)
 	char byte_file[1024];
 	unsigned char token;
 	int bcount;
+	double total = 0;
 
 	if (strlen(argv1) > 1012)
 	{
@@ -201,14 +1156,34 @@ int main(int argc, char **argv)
 	    exit(1);
 	}
 
+	for (unsigned int i = 0; i < 256; i++)
+	    total += bytes[i];
+
+	/*
+	 * weighted lists repeat each byte in proportion to its count - at
+	 *  least once so that every byte found is in the corpus
+	 */
 	bcount = 0;
 	for (unsigned int i = 0; i < 256; i++)
 	{
+	    int weight = 1;
+
 	    if (bytes[i] == 0)
 		continue;
+
+	    if (print_weights)
+	    {
+		weight = (int) (bytes[i] * WEIGHTS_TOTAL / total + 0.5);
+		if (weight < 1)
+		    weight = 1;
+	    }
+
 	    token = i & 0377;
-	    fputc(token, fp);
-	    bcount++;
+	    for (int j = 0; j < weight; j++)
+	    {
+		fputc(token, fp);
+		bcount++;
+	    }
 	}
 
 	fclose(fp);
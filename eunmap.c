@@ -23,7 +23,7 @@ SOFTWARE.
 
  *  unmap encrypted file through a corpus file for purposes of decrypting
  */
-#define _POSIX_C_SOURCE 1
+#define _POSIX_C_SOURCE 200809L
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -34,9 +34,16 @@ SOFTWARE.
 #include <sys/mman.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include "estats.h"
+#include "earchive.h"
+#include "esync.h"
+#include "ecorpus_tokens.h"
+#include "efingerprint.h"
+#include "ecompress.h"
+#include "eio.h"
+#include "eparse.h"
 
-extern void ecorpus_tokens_init(char *argv0, char *stream_file);
-extern unsigned char ecorpus_next_token ();
 
 void
 fail(char *argv0)
@@ -45,32 +52,720 @@ fail(char *argv0)
     fprintf(stderr, "  %s corpusfilename inputfilename outputfilename\n",
 	    argv0);
     fprintf(stderr, "  %s: use \"-start N\" to start reading after the first N bytes of the corpus file\n", argv0);
+    fprintf(stderr, "  %s: use \"-stats\" or \"-stats_json\" to report counters on standard error\n", argv0);
+    fprintf(stderr, "  %s: use \"-range OFF:LEN\" to decrypt LEN bytes at plaintext offset OFF\n", argv0);
+    fprintf(stderr, "  %s: use \"-sync_file name\" to name the emap -sync file - inputfilename.sync\n", argv0);
+    fprintf(stderr, "  %s: use \"-pipeline\" to generate a stream: corpus on its own thread\n", argv0);
+    fprintf(stderr, "  %s: use \"-serial_io\" to read and write on the decoding thread\n", argv0);
+    fprintf(stderr, "  %s: use \"-prefetch N\" to prefetch corpus reads N bytes ahead - 0 for none\n", argv0);
+    fprintf(stderr, "  %s -list archivefilename\n", argv0);
+    fprintf(stderr, "  %s -member name corpusfilename archivefilename outputfilename\n", argv0);
+    fprintf(stderr, "  %s -extract corpusfilename archivefilename outputdirectory\n", argv0);
+    fprintf(stderr, "  %s: use \"-threads N\" to set the number of -extract worker threads\n", argv0);
     exit(1);
 }
 
-int main(int argc, char *argv[])
+/*
+ * decode size_input bytes of distances into corpus bytes - or until the
+ *  end of the input when redirect_stdin is set
+ *
+ *  decoding begins at index_corpus and wraps back to start.  The first
+ *  skip bytes are not written and decoding stops after length bytes are
+ *  written - a length of -1 writes them all.  A stream corpus is read
+ *  from its ring when one is running.
+ *
+ *  when header is set the input may start with an emap -fingerprint
+ *  header.  It is checked before anything is decoded.  The output of an
+ *  emap -compress input is decompressed on its own thread.  A distance past
+ *  the end of a corpus file stops the decode - the corpus or the start
+ *  is wrong.
+ *
+ *  the input and output go through eio buffers - see eio.h - filled and
+ *  emptied on their own threads unless serial_io is set.  With a corpus
+ *  file most of the input is decoded straight from the input buffer by
+ *  unmap_run().
+ *
+ *  the corpus source and the kind of input do not change during a run.
+ *  unmap_loop() is inlined into one copy for each combination with those
+ *  two as constants, so the per byte tests on them drop out of the loop.
+ *  unmap() picks the copy once.
+ */
+enum unmap_source
+{
+    UNMAP_FILE,		// a mapped corpus file
+    UNMAP_STREAM,	// a stream: corpus generated inline
+    UNMAP_RING,		// a stream: corpus generated by eunmap -pipeline
+    UNMAP_SOURCES
+};
+
+struct unmap
 {
     unsigned char *corpus;
+    off_t size_corpus;
+    struct ecorpus_stream *stream;
+    struct ecorpus_ring *ring;
+    off_t start;
+    off_t index_corpus;
+    FILE *fp_input;
+    off_t size_input;
+    FILE *fp_output;
+    off_t skip;
+    off_t length;
+    bool header;	// a fingerprint header may come first
+    uint64_t check;	// the header check for this corpus and start
+    char *argv0;
+    struct ecompress *codec;	// decompressing into fp_plain
+    FILE *fp_plain;
+    bool serial_io;
+    size_t prefetch;	// corpus reads prefetched ahead - see eparse.h
+    struct eio *input;
+    struct eio *output;
+    off_t size_output;
+};
+
+/*
+ * the rest of a fingerprint header after its zero zero
+ */
+static void
+unmap_header(struct unmap *u)
+{
+    unsigned char header[EFINGERPRINT_SIZE] = { 0, 0 };
+    unsigned char codec;
+    uint64_t check;
+    int i;
+
+    for (i = 2; i < EFINGERPRINT_SIZE; i++)
+    {
+	int c = eio_getc(u->input);
+
+	if (c == EOF)
+	    break;
+	header[i] = c;
+    }
+    if (i != EFINGERPRINT_SIZE ||
+	efingerprint_get(header, &codec, &check) == false)
+    {
+	fprintf(stderr, "%s: the input does not start like an emap output\n",
+		u->argv0);
+	exit(1);
+    }
+
+    if (check != u->check)
+    {
+	fprintf(stderr, "%s: the input was encrypted with another corpus or -start\n",
+		u->argv0);
+	exit(1);
+    }
+
+    // nothing has been written yet - the output moves to the pipe
+    if (codec == EFINGERPRINT_GZIP)
+    {
+	eio_close(u->output);
+	u->fp_plain = u->fp_output;
+	u->codec = edecompress_start(u->argv0, u->fp_plain, &u->fp_output);
+	u->output = eio_open(u->argv0, u->fp_output, true, u->serial_io == false);
+    }
+    else if (codec != EFINGERPRINT_PLAIN)
+    {
+	fprintf(stderr, "%s: the input is compressed with an unknown codec (%c)\n",
+		u->argv0, codec);
+	exit(1);
+    }
+}
+
+/*
+ * decode corpus file distances from in to out a block at a time -
+ *  returns the input bytes used and sets *written to the output bytes
+ *
+ *  the corpus positions of up to EPARSE_BATCH output bytes are worked
+ *  out by eparse_positions() and then read together by eparse_gather(),
+ *  prefetching u->prefetch positions ahead.  What eparse_positions()
+ *  stops short of - the last bytes of the input, less than a block of
+ *  room in out, a distance past the end of the corpus - is left to the
+ *  byte at a time loop.
+ */
+static inline size_t
+unmap_run(struct unmap *u, off_t *index_corpus, const unsigned char *in,
+	  size_t size_in, unsigned char *out, size_t size_out, size_t *written)
+{
+    off_t positions[EPARSE_BATCH];
+    size_t p = 0;
+    size_t w = 0;
+    size_t used;
+    size_t n;
+
+    do
+    {
+	size_t room = size_out - w < EPARSE_BATCH ? size_out - w : EPARSE_BATCH;
+
+	n = eparse_positions(in + p, size_in - p, &used, index_corpus,
+			     u->start, u->size_corpus, positions, room);
+	eparse_gather(u->corpus, positions, n, out + w, u->prefetch);
+	p += used;
+	w += n;
+    } while (n + EPARSE_BLOCK > EPARSE_BATCH);	// stopped with a full batch
+
+    *written = w;
+    return p;
+}
+
+static inline __attribute__((always_inline)) void
+unmap_loop(struct unmap *u, const enum unmap_source source,
+	   const bool redirect_stdin)
+{
+    unsigned char *corpus = u->corpus;
+    off_t index_corpus = u->index_corpus;
+    struct eio *input = u->input;
+    struct eio *output = u->output;
+    off_t skip = u->skip;
+    off_t length = u->length;
+    unsigned char c;
+    off_t distance;
+    off_t distance2;
+    bool first = true;
+
+    for (off_t i = 0; redirect_stdin || i < u->size_input; )
+    {
+	if (source == UNMAP_FILE && skip == 0 &&
+	    (first == false || u->header == false))
+	{
+	    size_t size_in = input->length - input->position;
+	    size_t size_out = EIO_BUFFER - output->position;
+	    size_t used;
+	    size_t written;
+
+	    if (redirect_stdin == false && (off_t) size_in > u->size_input - i)
+		size_in = u->size_input - i;
+	    if (length > 0 && (off_t) size_out > length)
+		size_out = length;
+
+	    used = unmap_run(u, &index_corpus, input->data + input->position,
+			     size_in, output->data + output->position, size_out,
+			     &written);
+	    if (used > 0)
+	    {
+		input->position += used;
+		output->position += written;
+		if (redirect_stdin == false)
+		    i += used;
+		length -= written;
+		if (length == 0)
+		    break;
+		first = false;
+		continue;
+	    }
+	}
+
+	distance = eio_getc(input);
+	if (redirect_stdin)
+	{
+	    if (distance == EOF)
+		break;
+	} else
+	    i++;
+	distance &= 0377;
+	ESTATS_ADD(input_bytes, 1);
+
+	/*
+	 * zero distances mark wrap or counts larger than 255
+	 */
+	if (distance == 0)
+	{
+	    distance2 = eio_getc(input);
+	    if (redirect_stdin)
+	    {
+		if (distance2 == EOF)
+		    break;
+	    } else
+		i++;
+	    distance2 &= 0377;
+	    ESTATS_ADD(input_bytes, 1);
+
+	    /*
+	     * none found - wrap around the corpus
+	     */
+	    if (distance2 == 0)
+	    {
+		// a wrap cannot come first - it is a fingerprint header
+		if (first && u->header)
+		{
+		    unmap_header(u);
+		    output = u->output;
+		    if (redirect_stdin == false)
+			i += EFINGERPRINT_SIZE - 2;
+		    first = false;
+		    continue;
+		}
+		ESTATS_ADD(wraps, 1);
+		index_corpus = u->start;
+		continue;
+	    }
+	    ESTATS_ADD(long_distances, 1);
+	    ESTATS_ADD(escape_bytes, 2);
+
+	    /*
+	     * decode counts of greater than 255
+	     *
+	     * distances greater than 255 are encoded as counts of 255
+	     */
+	    while (distance2 != 0)
+	    {
+		distance = distance + (255 * distance2);
+		distance2 = eio_getc(input);
+		if (redirect_stdin)
+		{
+		    if (distance2 == EOF)
+			break;
+		} else
+		    i++;
+		distance2 &= 0377;
+		ESTATS_ADD(input_bytes, 1);
+		ESTATS_ADD(escape_bytes, 1);
+	    }
+
+	    distance2 = eio_getc(input);
+	    if (redirect_stdin)
+	    {
+		if (distance2 == EOF)
+		    break;
+	    } else
+		i++;
+	    distance2 &= 0377;
+	    ESTATS_ADD(input_bytes, 1);
+	    distance += distance2;
+	}
+
+	/*
+	 * advance the index into the corpus to the target byte
+	 */
+	first = false;
+	index_corpus += distance;
+	ESTATS_ADD(corpus_bytes_scanned, distance);
+
+	if (source == UNMAP_RING)
+	    c = ecorpus_ring_skip(u->ring, distance);
+	else if (source == UNMAP_STREAM)
+	{
+	    c = ecorpus_next_token(u->stream);
+	    for (int i = 1; i < distance; i++)
+		c = ecorpus_next_token(u->stream);
+	}
+	else
+	{
+	    if (index_corpus >= u->size_corpus)
+	    {
+		fprintf(stderr, "%s: the input runs past the end of the corpus - check the corpus and -start\n",
+			u->argv0);
+		exit(1);
+	    }
+	    c = corpus[index_corpus];
+	}
+
+	if (skip > 0)
+	{
+	    skip--;
+	    continue;
+	}
+
+	eio_putc(output, c);
+	ESTATS_ADD(output_bytes, 1);
+	if (--length == 0)
+	    break;
+    }
+}
+
+#define UNMAP_LOOP(name, source, redirect_stdin) \
+    static void name(struct unmap *u) { unmap_loop(u, source, redirect_stdin); }
+
+UNMAP_LOOP(unmap_file, UNMAP_FILE, false)
+UNMAP_LOOP(unmap_file_stdin, UNMAP_FILE, true)
+UNMAP_LOOP(unmap_stream, UNMAP_STREAM, false)
+UNMAP_LOOP(unmap_stream_stdin, UNMAP_STREAM, true)
+UNMAP_LOOP(unmap_ring, UNMAP_RING, false)
+UNMAP_LOOP(unmap_ring_stdin, UNMAP_RING, true)
+
+static void (*const unmap_loops[UNMAP_SOURCES][2])(struct unmap *) =
+{
+    { unmap_file, unmap_file_stdin },
+    { unmap_stream, unmap_stream_stdin },
+    { unmap_ring, unmap_ring_stdin },
+};
+
+/*
+ * false if the input could not be read or the output written
+ */
+static bool
+unmap(struct unmap *u, bool redirect_stdin)
+{
+    bool ok;
+
+    u->input = eio_open(u->argv0, u->fp_input, false, u->serial_io == false);
+    u->output = eio_open(u->argv0, u->fp_output, true, u->serial_io == false);
+
+    unmap_loops[u->ring != NULL ? UNMAP_RING :
+		u->stream != NULL ? UNMAP_STREAM : UNMAP_FILE][redirect_stdin](u);
+
+    ok = eio_close(u->input);
+    // with the bytes still in the last buffer
+    u->size_output = u->output->size_output + u->output->position;
+    ok = eio_close(u->output) && ok;
+
+    if (u->codec != NULL)
+    {
+	fclose(u->fp_output);
+	if (ecompress_finish(u->codec) == false)
+	    exit(1);
+	u->fp_output = u->fp_plain;
+    }
+
+    return ok;
+}
+
+/*
+ * archives from emap -archive - see earchive.h
+ */
+static struct earchive_member *archive_members;
+static uint64_t archive_count;
+static uint64_t archive_next = 0;
+static unsigned char *archive_corpus;
+static off_t archive_size_corpus;
+static char *archive_filename;
+static char *archive_outdir;
+static char *archive_argv0;
+static int archive_failures = 0;
+
+/*
+ * read the index at the end of the archive
+ */
+static void
+archive_read_index(char *argv0, char *filename)
+{
+    unsigned char footer[EARCHIVE_FOOTER_SIZE];
+    unsigned char entry[EARCHIVE_ENTRY_SIZE];
+    uint64_t index_offset;
+    off_t size_archive;
+    FILE *fp;
+
+    fp = fopen(filename, "r");
+    if (fp == NULL)
+    {
+	fprintf(stderr, "%s: cannot open the archive: %s\n", argv0, filename);
+	exit(1);
+    }
+
+    if (fseeko(fp, 0, SEEK_END) != 0 ||
+	(size_archive = ftello(fp)) < EARCHIVE_FOOTER_SIZE ||
+	fseeko(fp, size_archive - EARCHIVE_FOOTER_SIZE, SEEK_SET) != 0 ||
+	fread(footer, 1, sizeof(footer), fp) != sizeof(footer) ||
+	memcmp(footer, EARCHIVE_MAGIC, EARCHIVE_MAGIC_SIZE) != 0)
+    {
+	fprintf(stderr, "%s: not an archive: %s\n", argv0, filename);
+	exit(1);
+    }
+
+    index_offset = earchive_get(footer + EARCHIVE_MAGIC_SIZE, 8);
+    archive_count = earchive_get(footer + EARCHIVE_MAGIC_SIZE + 8, 8);
+    if (index_offset > size_archive - EARCHIVE_FOOTER_SIZE ||
+	archive_count > (size_archive - EARCHIVE_FOOTER_SIZE - index_offset) /
+			EARCHIVE_ENTRY_SIZE ||
+	fseeko(fp, index_offset, SEEK_SET) != 0)
+    {
+	fprintf(stderr, "%s: bad archive index: %s\n", argv0, filename);
+	exit(1);
+    }
+
+    archive_members = (struct earchive_member *)
+	malloc((archive_count + 1) * sizeof(struct earchive_member));
+    if (archive_members == NULL)
+    {
+	fprintf(stderr, "%s: out of memory for the archive index\n", argv0);
+	exit(1);
+    }
+
+    for (uint64_t i = 0; i < archive_count; i++)
+    {
+	struct earchive_member *member = &archive_members[i];
+	uint64_t name_length;
+
+	if (fread(entry, 1, sizeof(entry), fp) != sizeof(entry))
+	    name_length = EARCHIVE_NAME_MAX;
+	else
+	    name_length = earchive_get(entry + 32, 4);
+
+	member->offset = earchive_get(entry, 8);
+	member->length = earchive_get(entry + 8, 8);
+	member->start = earchive_get(entry + 16, 8);
+	member->size = earchive_get(entry + 24, 8);
+	member->name = malloc(name_length + 1);
+	if (name_length >= EARCHIVE_NAME_MAX || member->name == NULL ||
+	    fread(member->name, 1, name_length, fp) != name_length ||
+	    member->offset > index_offset ||
+	    member->length > index_offset - member->offset ||
+	    member->start > UINT_MAX)
+	{
+	    fprintf(stderr, "%s: bad archive index: %s\n", argv0, filename);
+	    exit(1);
+	}
+	member->name[name_length] = '\0';
+    }
+
+    fclose(fp);
+}
+
+/*
+ * decrypt one member - the ciphertext is read from its own stream so
+ *  members can be decrypted at the same time
+ */
+static bool
+archive_unmap(struct earchive_member *member, char *output)
+{
+    FILE *fp_input;
+    FILE *fp_output;
+    bool ok;
+
+    fp_input = fopen(archive_filename, "r");
+    if (fp_input == NULL || fseeko(fp_input, member->offset, SEEK_SET) != 0)
+    {
+	fprintf(stderr, "%s: cannot read the archive: %s\n",
+		archive_argv0, archive_filename);
+	if (fp_input != NULL)
+	    fclose(fp_input);
+	return false;
+    }
+
+    if (strcmp("-", output) == 0)
+	fp_output = stdout;
+    else
+	fp_output = fopen(output, "wb");
+    if (fp_output == NULL)
+    {
+	fprintf(stderr, "%s: cannot create the outout file: %s\n",
+		archive_argv0, output);
+	fclose(fp_input);
+	return false;
+    }
+
+    struct unmap u =
+    {
+	.corpus = archive_corpus,
+	.size_corpus = archive_size_corpus,
+	.start = member->start,
+	.index_corpus = member->start,
+	.fp_input = fp_input,
+	.size_input = member->length,
+	.fp_output = fp_output,
+	.length = -1,
+	.argv0 = archive_argv0,
+	.serial_io = true,	// the members are already decrypted in parallel
+	.prefetch = EPARSE_PREFETCH,
+    };
+
+    ok = unmap(&u, false) && u.size_output == (off_t) member->size;
+    if (fp_output == stdout)
+	ok = fflush(stdout) == 0 && ok;
+    else
+	ok = fclose(fp_output) == 0 && ok;
+    fclose(fp_input);
+
+    if (ok == false)
+	fprintf(stderr, "%s: member %s did not decrypt to %lu bytes\n",
+		archive_argv0, member->name, (unsigned long) member->size);
+    return ok;
+}
+
+/*
+ * the path under the output directory - leading slashes are dropped,
+ *  ".." is refused and missing directories are created
+ */
+static bool
+archive_path(char *name, char *path, size_t size)
+{
+    char *component;
+    int length;
+
+    while (*name == '/')
+	name++;
+
+    length = snprintf(path, size, "%s/%s", archive_outdir, name);
+    if (length < 0 || length >= size || *name == '\0')
+	return false;
+
+    component = path + strlen(archive_outdir) + 1;
+    while (true)
+    {
+	char *slash = strchr(component, '/');
+
+	if (strncmp(component, "..", 2) == 0 &&
+	    (component[2] == '/' || component[2] == '\0'))
+	    return false;
+	if (slash == NULL)
+	    break;
+
+	*slash = '\0';
+	mkdir(path, 0777);
+	*slash = '/';
+	component = slash + 1;
+    }
+
+    return true;
+}
+
+static void *
+archive_worker(void *arg)
+{
+    char path[8192];
+
+    while (true)
+    {
+	uint64_t next = __atomic_fetch_add(&archive_next, 1, __ATOMIC_RELAXED);
+	struct earchive_member *member;
+
+	if (next >= archive_count)
+	    break;
+	member = &archive_members[next];
+
+	if (archive_path(member->name, path, sizeof(path)) == false)
+	{
+	    fprintf(stderr, "%s: refusing to extract member: %s\n",
+		    archive_argv0, member->name);
+	    __atomic_fetch_add(&archive_failures, 1, __ATOMIC_RELAXED);
+	    continue;
+	}
+
+	if (archive_unmap(member, path) == false)
+	    __atomic_fetch_add(&archive_failures, 1, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+/*
+ * list, decrypt one member of or extract all of an archive
+ */
+static int
+archive(char *argv0, char *corpus_filename, char *filename, char *output,
+	char *member_name, bool list, unsigned long threads)
+{
+    struct stat s;
+    pthread_t *tids;
+    int fd;
+
+    archive_argv0 = argv0;
+    archive_filename = filename;
+    archive_read_index(argv0, filename);
+
+    if (list)
+    {
+	for (uint64_t i = 0; i < archive_count; i++)
+	    fprintf(stdout, "%lu %lu %lu %s\n",
+		    (unsigned long) archive_members[i].start,
+		    (unsigned long) archive_members[i].size,
+		    (unsigned long) archive_members[i].length,
+		    archive_members[i].name);
+	return 0;
+    }
+
+    if (strncmp("stream:", corpus_filename, 7) == 0)
+    {
+	fprintf(stderr, "%s: archives need a corpus file - not a stream\n",
+		argv0);
+	fail(argv0);
+    }
+
+    fd = open(corpus_filename, O_RDONLY);
+    if (fd == -1)
+    {
+	fprintf(stderr, "%s: cannot read the corpus file: %s\n",
+		argv0, corpus_filename);
+	exit(1);
+    }
+    fstat(fd, &s);
+    archive_size_corpus = s.st_size;
+    archive_corpus = (unsigned char *) mmap(0, s.st_size, PROT_READ,
+					    MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (archive_corpus == MAP_FAILED)
+    {
+	fprintf(stderr, "%s: cannot map the corpus file: %s\n",
+		argv0, corpus_filename);
+	exit(1);
+    }
+
+    if (member_name != NULL)
+    {
+	for (uint64_t i = 0; i < archive_count; i++)
+	    if (strcmp(archive_members[i].name, member_name) == 0)
+		return archive_unmap(&archive_members[i], output) ? 0 : 1;
+
+	fprintf(stderr, "%s: no member %s in the archive: %s\n",
+		argv0, member_name, filename);
+	return 1;
+    }
+
+    archive_outdir = output;
+    if (mkdir(output, 0777) != 0 && (stat(output, &s) != 0 ||
+				       S_ISDIR(s.st_mode) == 0))
+    {
+	fprintf(stderr, "%s: cannot create the output directory: %s\n",
+		argv0, output);
+	fail(argv0);
+    }
+
+    tids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+    for (unsigned long i = 0; i < threads; i++)
+	if (pthread_create(&tids[i], NULL, archive_worker, NULL) != 0)
+	{
+	    fprintf(stderr, "%s: cannot create the archive thread\n", argv0);
+	    exit(1);
+	}
+    for (unsigned long i = 0; i < threads; i++)
+	pthread_join(tids[i], NULL);
+    free(tids);
+
+    return archive_failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned char *corpus = NULL;
 
     int fd_corpus = 0;
     struct stat s;
     off_t size_corpus = UINT_MAX;
     off_t size_input;
     unsigned long start = 0;
-    bool streaming_corpus = false;
+    struct ecorpus_stream *stream = NULL;
 
     bool redirect_stdin = false;
     FILE *fp_input;
     FILE *fp_output;
 
-    unsigned char c;
+
+    bool stats = false;
+    bool stats_json = false;
+    bool list = false;
+    bool extract = false;
+    bool pipeline = false;
+    bool serial_io = false;
+    size_t prefetch = EPARSE_PREFETCH;
+    struct ecorpus_ring *ring = NULL;
+    char *member_name = NULL;
+    unsigned long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    bool range = false;
+    off_t range_offset = 0;
+    off_t range_length = -1;
     off_t index_corpus;
-    off_t distance;
-    off_t distance2;
+    off_t index_plain = 0;
+    uint64_t corpus_fingerprint;
+    uint64_t check;
+    char *sync_filename = NULL;
+    char sync_name[4096];
 
     char *args[4] = { "", "", "", ""};
     int argsc = 1;
 
+    ESTATS_PHASE(ESTATS_SETUP);
+
     /*
      * parse the arguments to the program
      */
@@ -103,20 +798,181 @@ int main(int argc, char *argv[])
 	    i++;
 	    continue;
 	}
+
+	if (strcmp(argv[i], "-stats") == 0)
+	{
+	    stats = true;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-stats_json") == 0)
+	{
+	    stats = true;
+	    stats_json = true;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-range") == 0)
+	{
+	    unsigned long long scan_offset;
+	    unsigned long long scan_length;
+
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -range value given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    if (sscanf(argv[i + 1], "%llu:%llu", &scan_offset, &scan_length) != 2 ||
+		scan_length == 0 || scan_offset > LLONG_MAX ||
+		scan_length > LLONG_MAX)
+	    {
+		fprintf(stderr, "%s: -range value (%s) is not OFF:LEN with a length of 1 or more\n",
+			argv[0], argv[i + 1]);
+		fail(argv[0]);
+	    }
+
+	    range = true;
+	    range_offset = scan_offset;
+	    range_length = scan_length;
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-sync_file") == 0)
+	{
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -sync_file name given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    sync_filename = argv[i + 1];
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-list") == 0)
+	{
+	    list = true;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-extract") == 0)
+	{
+	    extract = true;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-pipeline") == 0)
+	{
+	    pipeline = true;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-serial_io") == 0)
+	{
+	    serial_io = true;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-member") == 0)
+	{
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -member name given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    member_name = argv[i + 1];
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-prefetch") == 0)
+	{
+	    unsigned int rvalue;
+	    unsigned long scan_token;
+
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -prefetch value given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    rvalue = sscanf(argv[i + 1], "%lu", &scan_token);
+	    if (rvalue == 0 || rvalue == EOF || scan_token >= EPARSE_BATCH)
+	    {
+		fprintf(stderr, "%s: -prefetch value (%s) is not an integer in the range of 0 to %d\n",
+			argv[0], argv[i + 1], EPARSE_BATCH - 1);
+		fail(argv[0]);
+	    }
+
+	    prefetch = scan_token;
+	    i++;
+	    continue;
+	}
+
+	if (strcmp(argv[i], "-threads") == 0)
+	{
+	    unsigned int rvalue;
+	    unsigned long scan_token;
+
+	    if  (argc <= i + 1)
+	    {
+		fprintf(stderr, "%s: no -threads value given\n", argv[0]);
+		fail(argv[0]);
+	    }
+
+	    rvalue = sscanf(argv[i + 1], "%lu", &scan_token);
+	    if (rvalue == 0 || rvalue == EOF || scan_token == 0 || scan_token > 1024)
+	    {
+		fprintf(stderr, "%s: -threads value (%s) is not an integer in the range of 1 to 1024\n",
+			argv[0], argv[i + 1]);
+		fail(argv[0]);
+	    }
+
+	    threads = scan_token;
+	    i++;
+	    continue;
+	}
 	args[argsc] = argv[i];
 	argsc++;
     }
 
+    if (list)
+    {
+	if (argsc != 2)
+	    fail(args[0]);
+	return archive(args[0], NULL, args[1], NULL, NULL, true, threads);
+    }
+
+    if (member_name != NULL || extract)
+    {
+	if (argsc != 4 || (member_name != NULL && extract) || pipeline)
+	    fail(args[0]);
+	if (threads < 1)
+	    threads = 1;
+	return archive(args[0], args[1], args[2], args[3], member_name, false,
+		       threads);
+    }
+
     if (argsc != 4)
 	fail(args[0]);
 
+    if (stats && ESTATS_ENABLED == 0)
+	fprintf(stderr, "%s: -stats needs a build with the counters: make stats\n",
+		args[0]);
+
     /*
      * map the corpus file
      */
     if (strncmp("stream:", args[1], 7) == 0)
+	stream = ecorpus_tokens_open(args[0], args[1]);
+    else if (pipeline)
     {
-	ecorpus_tokens_init(args[0], args[1]);
-	streaming_corpus = true;
+	fprintf(stderr, "%s: -pipeline needs a stream: corpus\n", args[0]);
+	fail(args[0]);
     }
     else
     {
@@ -177,97 +1033,141 @@ int main(int argc, char *argv[])
     }
 
     /*
-     * adjust the start - if it is set
+     * a range starts from the last sync point at or before its offset
      */
     index_corpus = start;
-    if (streaming_corpus)
+    if (range)
     {
-	for (int i = 0; i <= start; i++)
-	    ecorpus_next_token();
+	struct esync sync;
+	FILE *fp_sync;
+
+	if (redirect_stdin)
+	{
+	    fprintf(stderr, "%s: -range needs an input file - not standard input\n",
+		    args[0]);
+	    fail(args[0]);
+	}
+	if (sync_filename == NULL)
+	{
+	    snprintf(sync_name, sizeof(sync_name), "%s.sync", args[2]);
+	    sync_filename = sync_name;
+	}
+
+	fp_sync = fopen(sync_filename, "r");
+	if (fp_sync == NULL)
+	{
+	    fprintf(stderr, "%s: cannot open the sync file: %s\n",
+		    args[0], sync_filename);
+	    exit(1);
+	}
+
+	// the first sync point is at the -start value
+	if (esync_read(fp_sync, 0, &sync))
+	    start = sync.index;
+	if (esync_find(fp_sync, range_offset, &sync) == false ||
+	    sync.cipher > size_input || sync.index >= size_corpus ||
+	    fseeko(fp_input, sync.cipher, SEEK_SET) != 0)
+	{
+	    fprintf(stderr, "%s: bad sync file: %s\n", args[0], sync_filename);
+	    exit(1);
+	}
+	fclose(fp_sync);
+
+	size_input -= sync.cipher;
+	index_corpus = sync.index;
+	index_plain = sync.plain;
     }
 
     /*
-     * loop through the input finding corpus token distances
+     * the check value of an emap -fingerprint header for this corpus and
+     *  start.  A range is decoded from the middle so its header is read
+     *  here.
      */
-    for (off_t i = 0; i < size_input; )
+    if (stream != NULL)
     {
-	distance = fgetc(fp_input) & 0377;
-	if (redirect_stdin)
+	if (efingerprint_stream(args[1], &corpus_fingerprint) == false)
 	{
-	    if(feof(stdin))
-		break;
-	} else
-	    i++;
+	    fprintf(stderr, "%s: cannot read the stream file: %s\n",
+		    args[0], args[1]);
+	    exit(1);
+	}
+    }
+    else
+	corpus_fingerprint = efingerprint_corpus(corpus, size_corpus);
+    check = efingerprint_check(corpus_fingerprint, start);
 
-	/*
-	 * zero distances mark wrap or counts larger than 255
-	 */
-	if (distance == 0)
-	{
-	    distance2 = fgetc(fp_input) & 0377;
-	    if (redirect_stdin)
-	    {
-		if (feof(stdin))
-		    break;
-	    } else
-		i++;
+    if (range)
+    {
+	unsigned char header[EFINGERPRINT_SIZE];
+	unsigned char codec;
+	uint64_t header_check;
 
-	    /*
-	     * none found - wrap around the corpus
-	     */
-	    if (distance2 == 0)
+	if (pread(fileno(fp_input), header, EFINGERPRINT_SIZE, 0) ==
+	    EFINGERPRINT_SIZE &&
+	    efingerprint_get(header, &codec, &header_check))
+	{
+	    if (header_check != check)
 	    {
-		index_corpus = start;
-		continue;
+		fprintf(stderr, "%s: the input was encrypted with another corpus or -start\n",
+			args[0]);
+		exit(1);
 	    }
-
-	    /*
-	     * decode counts of greater than 255
-	     *
-	     * distances greater than 255 are encoded as counts of 255
-	     */
-	    while (distance2 != 0)
+	    if (codec != EFINGERPRINT_PLAIN)
 	    {
-		distance = distance + (255 * distance2);
-		distance2 = fgetc(fp_input) & 0377;
-		if (redirect_stdin)
-		{
-		    if (feof(stdin))
-			break;
-		} else
-		    i++;
+		fprintf(stderr, "%s: -range cannot decrypt a compressed input\n",
+			args[0]);
+		exit(1);
 	    }
-
-	    distance2 = fgetc(fp_input) & 0377;
-	    if (redirect_stdin)
-	    {
-		if (feof(stdin))
-		    break;
-	    } else
-		i++;
-	    distance += distance2;
 	}
+    }
 
-	/*
-	 * advance the index into the corpus to the target byte
-	 */
-	index_corpus += distance;
+    /*
+     * adjust the start - if it is set
+     */
+    ESTATS_PHASE(ESTATS_SEEK);
+    if (stream != NULL)
+	ecorpus_tokens_seek(stream, index_corpus + 1);
+    if (stream != NULL && pipeline)
+	ring = ecorpus_ring_open(stream, ECORPUS_RING_SIZE);
 
-	if (streaming_corpus)
-	{
-	    c = ecorpus_next_token();
-	    for (int i = 1; i < distance; i++)
-		c = ecorpus_next_token();
-	}
-	else
-	    c = corpus[index_corpus];
+    /*
+     * loop through the input finding corpus token distances
+     */
+    ESTATS_PHASE(ESTATS_LOOP);
+    struct unmap u =
+    {
+	.corpus = corpus,
+	.size_corpus = size_corpus,
+	.stream = stream,
+	.ring = ring,
+	.start = start,
+	.index_corpus = index_corpus,
+	.fp_input = fp_input,
+	.size_input = size_input,
+	.fp_output = fp_output,
+	.skip = range_offset - index_plain,
+	.length = range_length,
+	.header = range == false,
+	.check = check,
+	.argv0 = args[0],
+	.serial_io = serial_io,
+	.prefetch = prefetch,
+    };
 
-	fputc(c, fp_output);
+    if (unmap(&u, redirect_stdin) == false)
+    {
+	fprintf(stderr, "%s: cannot read the input or write the output\n",
+		args[0]);
+	exit(1);
     }
 
+    ecorpus_ring_close(ring);
     fclose(fp_output);
     fclose(fp_input);
     close(fd_corpus);
 
+    if (stats)
+	ESTATS_REPORT(stderr, args[0], stats_json);
+
     return 0;
 }
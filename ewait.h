@@ -0,0 +1,107 @@
+/*
+ * ewait.h: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  waiting for another thread without burning a core
+ *
+ *  the eio buffer queues and the stream ring pass work between two
+ *  threads with atomic counters.  A thread with nothing to do spins on
+ *  its counter for a short while, since the other thread is usually
+ *  about to publish, and then sleeps on a condition variable.  The
+ *  publishing thread stores its counter and calls ewait_wake(), which
+ *  takes the lock only when a thread is asleep.  The fences on both
+ *  sides mean either the waiter sees the new counter or the publisher
+ *  sees the waiter.
+ */
+#ifndef EWAIT_H
+#define EWAIT_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#define EWAIT_SPINS 4096
+
+struct ewait
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int waiting;		// threads asleep or going to sleep
+};
+
+static inline void
+ewait_init(struct ewait *w)
+{
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    w->waiting = 0;
+}
+
+static inline void
+ewait_destroy(struct ewait *w)
+{
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+}
+
+static inline void
+ewait_unlock(void *lock)
+{
+    pthread_mutex_unlock((pthread_mutex_t *) lock);
+}
+
+/*
+ * wait until ready(arg) is true - a cancellation point once asleep
+ */
+static inline void
+ewait_until(struct ewait *w, bool (*ready)(void *), void *arg)
+{
+    for (int i = 0; i < EWAIT_SPINS; i++)
+	if (ready(arg))
+	    return;
+
+    pthread_mutex_lock(&w->lock);
+    pthread_cleanup_push(ewait_unlock, &w->lock);
+    __atomic_add_fetch(&w->waiting, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    while (ready(arg) == false)
+	pthread_cond_wait(&w->cond, &w->lock);
+    __atomic_sub_fetch(&w->waiting, 1, __ATOMIC_SEQ_CST);
+    pthread_cleanup_pop(1);
+}
+
+/*
+ * wake the waiters after the state they wait on is stored - only a
+ *  fence and a load when no one is asleep
+ */
+static inline void
+ewait_wake(struct ewait *w)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&w->waiting, __ATOMIC_RELAXED) == 0)
+	return;
+
+    pthread_mutex_lock(&w->lock);
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+#endif
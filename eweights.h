@@ -0,0 +1,75 @@
+/*
+ * eweights.h: Original work Copyright (C) 2020 by Doug Blewett
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ *  corpus byte weights from a byte list
+ *
+ *  ecorpus -weighted and the stream corpora build the same table of
+ *  weighted byte values, and etally -advise models the corpus that
+ *  ecorpus would make from it.  All three share this builder.
+ */
+#ifndef EWEIGHTS_H
+#define EWEIGHTS_H
+
+#include <math.h>
+
+/*
+ * -weighted byte lists are scaled to uniform blocks of about this size.
+ *  Small blocks keep the distances to the rare bytes under 255.
+ */
+#define EWEIGHTS_BLOCK 128
+
+/*
+ * convert the byte_list counts to weights in a block of EWEIGHTS_BLOCK
+ *
+ *  the mean distance to a plaintext byte is smallest when the corpus
+ *  frequency of each byte is proportional to the square root of its
+ *  plaintext frequency.  Each byte found keeps a weight of at least one.
+ *  The table holds each byte value repeated by its weight and needs
+ *  EWEIGHTS_BLOCK + 256 bytes.
+ */
+static inline unsigned int
+eweights_build(int *bytes, unsigned char *table)
+{
+    double total = 0;
+    unsigned int weights_total = 0;
+
+    for (int i = 0; i < 256; i++)
+	total += sqrt(bytes[i]);
+
+    for (int i = 0; i < 256; i++)
+    {
+	if (bytes[i] == 0)
+	    continue;
+
+	bytes[i] = (int) (sqrt(bytes[i]) * EWEIGHTS_BLOCK / total + 0.5);
+	if (bytes[i] < 1)
+	    bytes[i] = 1;
+
+	for (int j = 0; j < bytes[i]; j++)
+	    table[weights_total++] = i;
+    }
+
+    return weights_total;
+}
+
+#endif